@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "pixel_display.h"
+#include "scene.h"
+#include "image.h"
+#include "job.h"
+
+// Offline renderer: polydraw_batch [-j jobs] [-f ppm|qoi] [-o dir] scene...
+//
+// Each scene file is rendered into a memory display and written
+// into the output directory as <scene name>.<format>. Every scene is a job
+// on one shared pool, and each scene's tiles are jobs as well, so idle
+// threads steal tiles from the scenes still rendering.
+
+#define MAX_PATH 4096
+
+typedef struct
+{
+  char** scenes;
+  int num_scenes;
+  const char* out_dir;
+  bool qoi;
+  job_pool_t* pool;
+  int num_failed;
+} batch_t;
+
+static void usage(void)
+{
+  fprintf(stderr,
+          "usage: polydraw_batch [-j jobs] [-f ppm|qoi] [-o dir] scene...\n");
+}
+
+static void output_path(batch_t* batch, const char* scene, char* out, size_t size)
+{
+  const char* name = strrchr(scene, '/');
+  name = name ? name + 1 : scene;
+
+  size_t len = strlen(name);
+  const char* ext = strrchr(name, '.');
+  if (ext && ext != name)
+    len = ext - name;
+
+  snprintf(out, size, "%s/%.*s.%s", batch->out_dir, (int) len, name,
+           batch->qoi ? "qoi" : "ppm");
+}
+
+static bool render_scene_file(batch_t* batch, const char* pathname)
+{
+  scene_t scene;
+  if (!load_scene(&scene, pathname))
+    return false;
+  
+  pixel_display_t display;
+  create_mem_pixel_display(&display, scene.w, scene.h);
+  if (!display.buf)
+  {
+    fprintf(stderr, "Out of memory rendering %s.\n", pathname);
+    delete_scene(&scene);
+    return false;
+  }
+  
+  pixel_display_fill_start(&display);
+  memset(display.buf, 0, sizeof(pixel_t) * display.w * display.h);
+  render_scene(&scene, &display, batch->pool);
+  pixel_display_fill_end(&display);
+
+  char out[MAX_PATH];
+  output_path(batch, pathname, out, sizeof(out));
+  bool ok = batch->qoi ? write_qoi(out, &display) : write_ppm(out, &display);
+
+  delete_pixel_display(&display);
+  delete_scene(&scene);
+  return ok;
+}
+
+static void render_scene_job(void* data, int index)
+{
+  batch_t* batch = (batch_t*) data;
+  if (!render_scene_file(batch, batch->scenes[index]))
+    __atomic_add_fetch(&batch->num_failed, 1, __ATOMIC_RELAXED);
+}
+
+int main(int argc, char** argv)
+{
+  batch_t batch;
+  batch.out_dir = ".";
+  batch.qoi = false;
+  batch.num_failed = 0;
+  
+  int jobs = job_default_threads();
+  
+  int opt;
+  while ((opt = getopt(argc, argv, "j:f:o:h")) != -1)
+  {
+    switch (opt)
+    {
+     case 'j':
+       jobs = atoi(optarg);
+       break;
+     case 'f':
+       if (!strcmp(optarg, "qoi"))
+         batch.qoi = true;
+       else if (!strcmp(optarg, "ppm"))
+         batch.qoi = false;
+       else
+       {
+         usage();
+         return EXIT_FAILURE;
+       }
+       break;
+     case 'o':
+       batch.out_dir = optarg;
+       break;
+     default:
+       usage();
+       return EXIT_FAILURE;
+    }
+  }
+
+  batch.scenes = argv + optind;
+  batch.num_scenes = argc - optind;
+  if (!batch.num_scenes || jobs < 1)
+  {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  job_pool_t pool;
+  create_job_pool(&pool, jobs);
+  batch.pool = &pool;
+
+  job_parallel_for(&pool, batch.num_scenes, render_scene_job, &batch);
+  
+  delete_job_pool(&pool);
+
+  if (batch.num_failed)
+  {
+    fprintf(stderr, "%d of %d scenes failed.\n", batch.num_failed, batch.num_scenes);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,699 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <stb/stretchy_buffer.h>
+
+#include "pixel_display.h"
+#include "draw.h"
+#include "geom.h"
+#include "spatial_hash.h"
+#include "job.h"
+#include "raster.h"
+#include "transform.h"
+#include "cpu.h"
+#include "kernels_check.h"
+
+// Rasterization micro-benchmarks: polydraw_bench [options]
+//
+//   --warmup n     untimed runs before measuring (default 3)
+//   --reps n       timed repetitions, the median is reported (default 10)
+//   --filter s     only run benchmarks whose name contains s
+//   --threads n    threads for the tiled benchmarks (default one per core)
+//   --json         print results as JSON
+//   --check        check the kernels of every SIMD level the CPU supports
+//                  against the scalar ones, then exit
+//
+// Each repetition runs a benchmark enough times to take at least
+// MIN_REP_TIME seconds, and reports ns/op along with the pixels and edges
+// processed per second. Kernels run at the level picked by cpu.c, set
+// POLYDRAW_SIMD to compare levels.
+
+#define MIN_REP_TIME 0.01
+#define MAX_REPS 1000
+
+typedef struct bench_t
+{
+  char name[64];
+  void (*run)(struct bench_t* bench);
+  
+  pixel_display_t* display;
+  polygon_t poly;
+  int args[4];
+
+  double pixels; // per op
+  double edges;  // per op
+} bench_t;
+
+typedef struct
+{
+  const char* name;
+  double ns_per_op;
+  double min_ns_per_op;
+  double pixels_per_s;
+  double edges_per_s;
+  long iters;
+} bench_result_t;
+
+static pixel_t bench_color = {.r = 255, .g = 255, .b = 255, .a = 255};
+static pixel_t bench_bg = {.r = 0, .g = 0, .b = 0, .a = 255};
+static volatile int bench_sink;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+// Benchmark bodies
+
+static void run_clear(bench_t* b)
+{
+  clear_display(b->display, bench_color);
+}
+
+static void run_line(bench_t* b)
+{
+  draw_line(b->display, bench_color, b->args[0], b->args[1], b->args[2], b->args[3]);
+}
+
+static void run_line_aa(bench_t* b)
+{
+  draw_line_aa(b->display, bench_color, b->args[0], b->args[1], b->args[2], b->args[3]);
+}
+
+static void run_point(bench_t* b)
+{
+  draw_point(b->display, bench_color, b->args[0], b->args[1], b->args[2]);
+}
+
+static void run_circle(bench_t* b)
+{
+  draw_circle(b->display, bench_color, b->args[0], b->args[1], b->args[2]);
+}
+
+static void run_points(bench_t* b)
+{
+  draw_polygon_points(b->display, bench_color, &b->poly, b->args[0]);
+}
+
+// Drops the span cache first so the polygon is scanned every time, see
+// run_scan_fill_cached
+static void run_scan_fill(bench_t* b)
+{
+  scan_fill_polygon(b->display, &b->poly)->span_caches[b->args[0]].version = 0;
+  scan_fill(b->display, bench_color, &b->poly, b->args[0]);
+}
+
+static void run_scan_fill_cached(bench_t* b)
+{
+  scan_fill(b->display, bench_color, &b->poly, b->args[0]);
+}
+
+static void count_span(void* data, int y, int x0, int x1)
+{
+  (*(int*) data)++;
+}
+
+// Only scans the polygon into spans, nothing is drawn
+static void run_scan_fill_rows(bench_t* b)
+{
+  int spans = 0;
+  scan_fill_rows(&b->poly, 0, b->display->h, b->args[0], count_span, &spans);
+  bench_sink = spans;
+}
+
+static void run_scan_fill_aa(bench_t* b)
+{
+  scan_fill_aa(b->display, bench_color, &b->poly, b->args[0]);
+}
+
+static void run_triangle_fill(bench_t* b)
+{
+  triangle_fill(b->display, bench_color, &b->poly, b->args[0]);
+}
+
+// Translucent fill in the blend mode in args[1]
+static void run_blend_fill(bench_t* b)
+{
+  pixel_t color = {.r = 200, .g = 120, .b = 40, .a = 128};
+  b->display->blend = b->args[1];
+  scan_fill(b->display, color, &b->poly, b->args[0]);
+  b->display->blend = BLEND_REPLACE;
+}
+
+// Rotates the polygon's points a degree around its center
+static void run_transform(bench_t* b)
+{
+  mat3_t mat;
+  mat3_rotation(M_PI / 180, &mat);
+  point_t center = {.x = 960, .y = 540};
+  mat3_transform_points(&mat, center, b->poly.points, b->poly.num_points);
+}
+
+static job_pool_t bench_pool;
+static raster_t bench_raster;
+
+static void run_tiled_fill(bench_t* b)
+{
+  raster_fill(&bench_raster, bench_color, &b->poly, b->args[0]);
+  raster_flush(&bench_raster, b->display);
+  b->display->dirty.count = 0;
+}
+
+static void run_self_intersect(bench_t* b)
+{
+  bench_sink += poly_self_intersect(&b->poly);
+}
+
+// Touches the polygon first, so each call triangulates it again
+static void run_triangulate(bench_t* b)
+{
+  size_t num_triangles;
+  polygon_touch(&b->poly);
+  polygon_triangles(&b->poly, &num_triangles);
+  bench_sink += num_triangles;
+}
+
+// Short segment through the middle of the polygon, rotating each call
+static void run_segment_query(bench_t* b)
+{
+  static int i = 0;
+  float t = (i++ % 360) * (M_PI / 180);
+  point_t l1 = {.x = 960 + 450 * cosf(t), .y = 540 + 450 * sinf(t)};
+  point_t l2 = {.x = 960 + 550 * cosf(t), .y = 540 + 550 * sinf(t)};
+  bench_sink += line_poly_intersect(l1, l2, &b->poly);
+}
+
+static void run_contains_point(bench_t* b)
+{
+  static int i = 0;
+  point_t pt = {.x = 460 + (i * 37) % 1000, .y = 40 + (i * 101) % 1000};
+  i++;
+  bench_sink += polygon_contains_point(&b->poly, pt);
+}
+
+static void run_nearest_edge(bench_t* b)
+{
+  static int i = 0;
+  point_t pt = {.x = 460 + (i * 37) % 1000, .y = 40 + (i * 101) % 1000};
+  i++;
+  bench_sink += polygon_nearest_edge(&b->poly, pt, 20, NULL);
+}
+
+static spatial_hash_t bench_hash;
+
+static void run_pick(bench_t* b)
+{
+  // Walk the query point around so every call hits different cells
+  static int i = 0;
+  point_t pos = {.x = (i * 37) % b->display->w, .y = (i * 101) % b->display->h};
+  i++;
+  
+  vertex_ref_t ref;
+  bench_sink += spatial_hash_nearest(&bench_hash, pos, b->args[0], -1, &ref);
+}
+
+// Polygons
+
+static void regular_polygon(polygon_t* p, float cx, float cy, float r, int n)
+{
+  point_t* points = NULL;
+  for (int i = 0; i < n; i++)
+  {
+    float t = (2 * M_PI * i) / n;
+    point_t point = {.x = floorf(cx + r * cosf(t)), .y = floorf(cy + r * sinf(t))};
+    sb_push(points, point);
+  }
+  create_polygon_from_points(p, points, n);
+  sb_free(points);
+}
+
+// Alternates between two radii, which gives a concave star when the radii
+// are close and long spikes when they are far apart
+static void star_polygon(polygon_t* p, float cx, float cy, float r_in, float r_out, int n)
+{
+  point_t* points = NULL;
+  for (int i = 0; i < n; i++)
+  {
+    float t = (2 * M_PI * i) / n;
+    float r = (i % 2) ? r_in : r_out;
+    point_t point = {.x = floorf(cx + r * cosf(t)), .y = floorf(cy + r * sinf(t))};
+    sb_push(points, point);
+  }
+  create_polygon_from_points(p, points, n);
+  sb_free(points);
+}
+
+// Star shaped outline with random radii, always simple
+static void random_polygon(polygon_t* p, float cx, float cy, float r, int n)
+{
+  point_t* points = NULL;
+  for (int i = 0; i < n; i++)
+  {
+    float t = (2 * M_PI * i) / n;
+    float ri = r * (0.5f + 0.5f * (rand() / (float) RAND_MAX));
+    point_t point = {.x = cx + ri * cosf(t), .y = cy + ri * sinf(t)};
+    sb_push(points, point);
+  }
+  create_polygon_from_points(p, points, n);
+  sb_free(points);
+}
+
+// Star polygon {n/step}, self intersecting for step > 1
+static void winding_polygon(polygon_t* p, float cx, float cy, float r, int n, int step)
+{
+  point_t* points = NULL;
+  for (int i = 0; i < n; i++)
+  {
+    float t = (2 * M_PI * ((i * step) % n)) / n;
+    point_t point = {.x = cx + r * cosf(t), .y = cy + r * sinf(t)};
+    sb_push(points, point);
+  }
+  create_polygon_from_points(p, points, n);
+  sb_free(points);
+}
+
+static size_t count_fill_pixels(pixel_display_t* display, polygon_t* p, bool aa, fill_rule_t rule)
+{
+  clear_display(display, bench_bg);
+  if (aa)
+    scan_fill_aa(display, bench_color, p, rule);
+  else
+    scan_fill(display, bench_color, p, rule);
+  
+  size_t n = 0;
+  for (size_t i = 0; i < display->w * display->h; i++)
+  {
+    if (display->buf[i].r)
+      n++;
+  }
+  return n;
+}
+
+// Pixels of a filled circle, see fill_circle
+static size_t disc_pixels(int r)
+{
+  size_t n = 0;
+  for (int y = -r; y <= r; y++)
+  {
+    for (int x = -r; x <= r; x++)
+      n += (x * x) + (y * y) <= (r * r) + r;
+  }
+  return n;
+}
+
+// Registration
+
+static bench_t* g_benches = NULL;
+
+static bench_t* add_bench(const char* name, void (*run)(bench_t*), pixel_display_t* display)
+{
+  bench_t b;
+  memset(&b, 0, sizeof(b));
+  snprintf(b.name, sizeof(b.name), "%s", name);
+  b.run = run;
+  b.display = display;
+  create_polygon(&b.poly);
+  sb_push(g_benches, b);
+  return &sb_last(g_benches);
+}
+
+static void add_line_bench(const char* name, void (*run)(bench_t*), pixel_display_t* display,
+                           int x1, int y1, int x2, int y2)
+{
+  bench_t* b = add_bench(name, run, display);
+  b->args[0] = x1;
+  b->args[1] = y1;
+  b->args[2] = x2;
+  b->args[3] = y2;
+  int dx = abs(x2 - x1);
+  int dy = abs(y2 - y1);
+  b->pixels = dx > dy ? dx : dy;
+}
+
+static void measure_fill_bench(bench_t* b)
+{
+  b->pixels = count_fill_pixels(b->display, &b->poly, b->run == run_scan_fill_aa, b->args[0]);
+  b->edges = b->poly.num_edges;
+}
+
+static void register_benches(pixel_display_t* displays, int num_displays)
+{
+  char name[64];
+  pixel_display_t* d = displays;
+  bench_t* b;
+  
+  for (int i = 0; i < num_displays; i++)
+  {
+    snprintf(name, sizeof(name), "clear_display/%zux%zu", displays[i].w, displays[i].h);
+    b = add_bench(name, run_clear, displays + i);
+    b->pixels = displays[i].w * displays[i].h;
+  }
+
+  add_line_bench("draw_line/short", run_line, d, 100, 100, 110, 104);
+  add_line_bench("draw_line/long", run_line, d, 10, 20, 1900, 1000);
+  add_line_bench("draw_line/shallow", run_line, d, 10, 500, 1900, 540);
+  add_line_bench("draw_line/steep", run_line, d, 900, 10, 940, 1070);
+  add_line_bench("draw_line/offscreen", run_line, d, -200000, -109988, 200000, 110012);
+  add_line_bench("draw_line_aa/short", run_line_aa, d, 100, 100, 110, 104);
+  add_line_bench("draw_line_aa/long", run_line_aa, d, 10, 20, 1900, 1000);
+  add_line_bench("draw_line_aa/steep", run_line_aa, d, 900, 10, 940, 1070);
+  add_line_bench("draw_line_aa/offscreen", run_line_aa, d, -20000, -10988, 20000, 11012);
+
+  static const int radii[] = {0, 2, 5, 10};
+  for (int i = 0; i < sizeof(radii) / sizeof(radii[0]); i++)
+  {
+    snprintf(name, sizeof(name), "draw_point/r%d", radii[i]);
+    b = add_bench(name, run_point, d);
+    b->args[0] = 500;
+    b->args[1] = 500;
+    b->args[2] = radii[i];
+    b->pixels = disc_pixels(radii[i]);
+  }
+
+  b = add_bench("draw_circle/r100", run_circle, d);
+  b->args[0] = 500;
+  b->args[1] = 500;
+  b->args[2] = 100;
+  b->pixels = 8 * 100;
+
+  // Vertex markers on a large polygon
+  b = add_bench("draw_points/10k_r5", run_points, d);
+  random_polygon(&b->poly, 960, 540, 500, 10000);
+  b->args[0] = 5;
+  b->pixels = 10000 * disc_pixels(5);
+
+  b = add_bench("scan_fill/convex", run_scan_fill, d);
+  regular_polygon(&b->poly, 960, 540, 500, 64);
+  measure_fill_bench(b);
+  
+  b = add_bench("scan_fill/concave", run_scan_fill, d);
+  star_polygon(&b->poly, 960, 540, 350, 500, 64);
+  measure_fill_bench(b);
+  
+  b = add_bench("scan_fill/spiky", run_scan_fill, d);
+  star_polygon(&b->poly, 960, 540, 20, 520, 1024);
+  measure_fill_bench(b);
+
+  b = add_bench("scan_fill/star_nonzero", run_scan_fill, d);
+  winding_polygon(&b->poly, 960, 540, 500, 7, 3);
+  b->args[0] = FILL_NON_ZERO;
+  measure_fill_bench(b);
+
+  // The spiky star scaled up 40 times, mostly off screen
+  b = add_bench("scan_fill/zoomed", run_scan_fill, d);
+  star_polygon(&b->poly, 960, 540, 800, 20800, 1024);
+  measure_fill_bench(b);
+
+  b = add_bench("scan_fill_rows/convex", run_scan_fill_rows, d);
+  regular_polygon(&b->poly, 960, 540, 500, 64);
+  measure_fill_bench(b);
+
+  b = add_bench("scan_fill_rows/concave", run_scan_fill_rows, d);
+  star_polygon(&b->poly, 960, 540, 350, 500, 64);
+  measure_fill_bench(b);
+
+  // Unchanged polygons replay their cached spans
+  b = add_bench("scan_fill_cached/convex", run_scan_fill_cached, d);
+  regular_polygon(&b->poly, 960, 540, 500, 64);
+  measure_fill_bench(b);
+
+  b = add_bench("scan_fill_cached/spiky", run_scan_fill_cached, d);
+  star_polygon(&b->poly, 960, 540, 20, 520, 1024);
+  measure_fill_bench(b);
+
+  // Convex polygons are cut into triangles directly, others are
+  // triangulated through monotone pieces
+  b = add_bench("triangle_fill/convex", run_triangle_fill, d);
+  regular_polygon(&b->poly, 960, 540, 500, 64);
+  measure_fill_bench(b);
+
+  b = add_bench("triangle_fill/concave", run_triangle_fill, d);
+  star_polygon(&b->poly, 960, 540, 350, 500, 64);
+  measure_fill_bench(b);
+
+  b = add_bench("triangle_fill/small", run_triangle_fill, d);
+  regular_polygon(&b->poly, 960, 540, 20, 8);
+  measure_fill_bench(b);
+
+  b = add_bench("scan_fill/small", run_scan_fill, d);
+  regular_polygon(&b->poly, 960, 540, 20, 8);
+  measure_fill_bench(b);
+
+  b = add_bench("scan_fill_aa/convex", run_scan_fill_aa, d);
+  regular_polygon(&b->poly, 960, 540, 500, 64);
+  measure_fill_bench(b);
+  
+  b = add_bench("scan_fill_aa/concave", run_scan_fill_aa, d);
+  star_polygon(&b->poly, 960, 540, 350, 500, 64);
+  measure_fill_bench(b);
+  
+  b = add_bench("scan_fill_aa/spiky", run_scan_fill_aa, d);
+  star_polygon(&b->poly, 960, 540, 20, 520, 1024);
+  measure_fill_bench(b);
+  
+  b = add_bench("scan_fill_aa/star_nonzero", run_scan_fill_aa, d);
+  winding_polygon(&b->poly, 960, 540, 500, 7, 3);
+  b->args[0] = FILL_NON_ZERO;
+  measure_fill_bench(b);
+
+  b = add_bench("scan_fill_aa/zoomed", run_scan_fill_aa, d);
+  star_polygon(&b->poly, 960, 540, 800, 20800, 1024);
+  measure_fill_bench(b);
+
+  static const char* blend_names[] = {"over", "add", "multiply", "premultiplied"};
+  for (int i = 0; i < sizeof(blend_names) / sizeof(blend_names[0]); i++)
+  {
+    snprintf(name, sizeof(name), "blend_fill/%s", blend_names[i]);
+    b = add_bench(name, run_blend_fill, d);
+    regular_polygon(&b->poly, 960, 540, 500, 64);
+    measure_fill_bench(b);
+    b->args[1] = BLEND_OVER + i;
+  }
+
+  b = add_bench("transform_points/1M", run_transform, d);
+  random_polygon(&b->poly, 960, 540, 500, 1000000);
+
+  b = add_bench("tiled_fill/convex", run_tiled_fill, d);
+  regular_polygon(&b->poly, 960, 540, 500, 64);
+  measure_fill_bench(b);
+  
+  b = add_bench("tiled_fill/spiky", run_tiled_fill, d);
+  star_polygon(&b->poly, 960, 540, 20, 520, 1024);
+  measure_fill_bench(b);
+  
+  b = add_bench("tiled_fill/convex_4k", run_tiled_fill, displays + 2);
+  regular_polygon(&b->poly, 1920, 1080, 1000, 64);
+  measure_fill_bench(b);
+
+  static const int sizes[] = {64, 256, 1024, 4096};
+  for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    snprintf(name, sizeof(name), "poly_self_intersect/%d", sizes[i]);
+    b = add_bench(name, run_self_intersect, d);
+    random_polygon(&b->poly, 960, 540, 500, sizes[i]);
+    b->edges = b->poly.num_edges;
+  }
+
+  static const int triangulate_sizes[] = {64, 1024, 16384, 131072};
+  for (int i = 0; i < sizeof(triangulate_sizes) / sizeof(triangulate_sizes[0]); i++)
+  {
+    snprintf(name, sizeof(name), "polygon_triangles/%d", triangulate_sizes[i]);
+    b = add_bench(name, run_triangulate, d);
+    random_polygon(&b->poly, 960, 540, 500, triangulate_sizes[i]);
+    b->edges = b->poly.num_edges;
+  }
+
+  static void (*edge_queries[])(bench_t*) = {run_segment_query, run_contains_point, run_nearest_edge};
+  static const char* edge_query_names[] = {"line_poly_intersect", "polygon_contains_point",
+                                           "polygon_nearest_edge"};
+  for (int q = 0; q < 3; q++)
+  {
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+      snprintf(name, sizeof(name), "%s/%d", edge_query_names[q], sizes[i]);
+      b = add_bench(name, edge_queries[q], d);
+      random_polygon(&b->poly, 960, 540, 500, sizes[i]);
+    }
+  }
+
+  // A million vertices spread over the display, in polygons of 64
+  create_spatial_hash(&bench_hash, 16);
+  for (int i = 0; i < 1000000; i++)
+  {
+    vertex_ref_t ref = {.poly = i / 64, .point = i % 64};
+    point_t pos = {.x = rand() % d->w, .y = rand() % d->h};
+    spatial_hash_insert(&bench_hash, ref, pos);
+  }
+  
+  static const int pick_radii[] = {10, 20};
+  for (int i = 0; i < sizeof(pick_radii) / sizeof(pick_radii[0]); i++)
+  {
+    snprintf(name, sizeof(name), "spatial_hash_nearest/1M/r%d", pick_radii[i]);
+    b = add_bench(name, run_pick, d);
+    b->args[0] = pick_radii[i];
+  }
+}
+
+// Runner
+
+static int compare_doubles(const void* a, const void* b)
+{
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+static bench_result_t run_bench(bench_t* b, int warmup, int reps)
+{
+  for (int i = 0; i < warmup; i++)
+    b->run(b);
+
+  // Calibrate the iteration count
+  long iters = 1;
+  for (;;)
+  {
+    double start = now();
+    for (long i = 0; i < iters; i++)
+      b->run(b);
+    double elapsed = now() - start;
+    if (elapsed >= MIN_REP_TIME)
+      break;
+    if (elapsed * 10 < MIN_REP_TIME)
+      iters *= 10;
+    else
+      iters *= 2;
+  }
+
+  double samples[MAX_REPS];
+  for (int r = 0; r < reps; r++)
+  {
+    double start = now();
+    for (long i = 0; i < iters; i++)
+      b->run(b);
+    samples[r] = ((now() - start) * 1e9) / iters;
+  }
+  qsort(samples, reps, sizeof(double), compare_doubles);
+
+  bench_result_t result;
+  result.name = b->name;
+  result.ns_per_op = samples[reps / 2];
+  result.min_ns_per_op = samples[0];
+  result.pixels_per_s = b->pixels * 1e9 / result.ns_per_op;
+  result.edges_per_s = b->edges * 1e9 / result.ns_per_op;
+  result.iters = iters;
+  return result;
+}
+
+static void print_result(bench_result_t* r, bool json, bool first)
+{
+  if (json)
+  {
+    printf("%s\n    {\"name\": \"%s\", \"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, "
+           "\"pixels_per_s\": %.0f, \"edges_per_s\": %.0f, \"iters\": %ld}",
+           first ? "" : ",", r->name, r->ns_per_op, r->min_ns_per_op,
+           r->pixels_per_s, r->edges_per_s, r->iters);
+    return;
+  }
+  
+  printf("%-32s %14.1f ns/op", r->name, r->ns_per_op);
+  if (r->pixels_per_s > 0)
+    printf(" %12.2f Mpix/s", r->pixels_per_s * 1e-6);
+  if (r->edges_per_s > 0)
+    printf(" %12.2f Medges/s", r->edges_per_s * 1e-6);
+  printf("\n");
+}
+
+static void usage(void)
+{
+  fprintf(stderr,
+          "usage: polydraw_bench [--warmup n] [--reps n] [--filter name] [--threads n] [--json]\n"
+          "                      [--check]\n");
+}
+
+int main(int argc, char** argv)
+{
+  int warmup = 3;
+  int reps = 10;
+  const char* filter = NULL;
+  bool json = false;
+  int threads = job_default_threads();
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--json"))
+      json = true;
+    else if (!strcmp(argv[i], "--warmup") && i + 1 < argc)
+      warmup = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--reps") && i + 1 < argc)
+      reps = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+      filter = argv[++i];
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--check"))
+    {
+      srand(1);
+      return check_kernels() ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    else
+    {
+      usage();
+      return EXIT_FAILURE;
+    }
+  }
+  if (reps < 1 || reps > MAX_REPS || warmup < 0 || threads < 1)
+  {
+    usage();
+    return EXIT_FAILURE;
+  }
+
+  srand(1);
+  create_job_pool(&bench_pool, threads);
+  create_raster(&bench_raster, &bench_pool);
+  
+  pixel_display_t displays[3];
+  create_mem_pixel_display(&displays[0], 1920, 1080);
+  create_mem_pixel_display(&displays[1], 800, 600);
+  create_mem_pixel_display(&displays[2], 3840, 2160);
+
+  register_benches(displays, 3);
+
+  if (json)
+    printf("{\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"simd\": \"%s\",\n  \"results\": [",
+           warmup, reps, simd_level_name(simd_level()));
+  else
+    printf("simd: %s\n", simd_level_name(simd_level()));
+  
+  bool first = true;
+  for (int i = 0; i < sb_count(g_benches); i++)
+  {
+    bench_t* b = g_benches + i;
+    if (filter && !strstr(b->name, filter))
+      continue;
+
+    clear_display(b->display, bench_bg);
+    bench_result_t result = run_bench(b, warmup, reps);
+    print_result(&result, json, first);
+    first = false;
+  }
+
+  if (json)
+    printf("\n  ]\n}\n");
+
+  for (int i = 0; i < sb_count(g_benches); i++)
+    delete_polygon(&g_benches[i].poly);
+  sb_free(g_benches);
+  delete_spatial_hash(&bench_hash);
+  delete_raster(&bench_raster);
+  delete_job_pool(&bench_pool);
+  
+  for (int i = 0; i < 3; i++)
+    delete_pixel_display(displays + i);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,322 @@
+#include "bvh.h"
+
+// Enough for the depth of a median split tree over any array that fits
+// in memory
+#define BVH_STACK_SIZE 64
+
+static aabb_t aabb_union(aabb_t a, aabb_t b)
+{
+  aabb_t r;
+  r.min.x = a.min.x < b.min.x ? a.min.x : b.min.x;
+  r.min.y = a.min.y < b.min.y ? a.min.y : b.min.y;
+  r.max.x = a.max.x > b.max.x ? a.max.x : b.max.x;
+  r.max.y = a.max.y > b.max.y ? a.max.y : b.max.y;
+  return r;
+}
+
+static bool aabb_overlap(aabb_t a, aabb_t b)
+{
+  return a.min.x <= b.max.x && b.min.x <= a.max.x
+    && a.min.y <= b.max.y && b.min.y <= a.max.y;
+}
+
+// Twice the box centre, which orders the same
+static float centroid(const aabb_t* b, int axis)
+{
+  return axis ? b->min.y + b->max.y : b->min.x + b->max.x;
+}
+
+void create_bvh(bvh_t* bvh)
+{
+  bvh->nodes = NULL;
+  bvh->num_nodes = 0;
+  bvh->items = NULL;
+  bvh->num_items = 0;
+}
+
+void delete_bvh(bvh_t* bvh)
+{
+  free(bvh->nodes);
+  free(bvh->items);
+  create_bvh(bvh);
+}
+
+// Quickselect, moves the k-th item along the axis to position k with
+// smaller items before it
+static void select_median(int* items, int n, int k, const aabb_t* boxes, int axis)
+{
+  int lo = 0;
+  int hi = n - 1;
+  while (lo < hi)
+  {
+    float pivot = centroid(boxes + items[(lo + hi) / 2], axis);
+    int i = lo;
+    int j = hi;
+    while (i <= j)
+    {
+      while (centroid(boxes + items[i], axis) < pivot)
+        i++;
+      while (centroid(boxes + items[j], axis) > pivot)
+        j--;
+      if (i <= j)
+      {
+        int tmp = items[i];
+        items[i] = items[j];
+        items[j] = tmp;
+        i++;
+        j--;
+      }
+    }
+    if (k <= j)
+      hi = j;
+    else if (k >= i)
+      lo = i;
+    else
+      break;
+  }
+}
+
+static int build_node(bvh_t* bvh, const aabb_t* boxes, int first, int count)
+{
+  int index = bvh->num_nodes++;
+  bvh_node_t* node = bvh->nodes + index;
+
+  aabb_t box = boxes[bvh->items[first]];
+  aabb_t centres;
+  centres.min.x = centres.max.x = centroid(&box, 0);
+  centres.min.y = centres.max.y = centroid(&box, 1);
+  for (int i = first + 1; i < first + count; i++)
+  {
+    const aabb_t* b = boxes + bvh->items[i];
+    box = aabb_union(box, *b);
+    
+    aabb_t c;
+    c.min.x = c.max.x = centroid(b, 0);
+    c.min.y = c.max.y = centroid(b, 1);
+    centres = aabb_union(centres, c);
+  }
+  node->box = box;
+  
+  if (count <= BVH_LEAF_SIZE)
+  {
+    node->right = -1;
+    node->first = first;
+    node->count = count;
+    return index;
+  }
+
+  int axis = (centres.max.y - centres.min.y) > (centres.max.x - centres.min.x);
+  int half = count / 2;
+  select_median(bvh->items + first, count, half, boxes, axis);
+  
+  node->first = -1;
+  node->count = 0;
+  build_node(bvh, boxes, first, half);
+  node->right = build_node(bvh, boxes, first + half, count - half);
+  return index;
+}
+
+void bvh_build(bvh_t* bvh, const aabb_t* boxes, size_t num_boxes)
+{
+  delete_bvh(bvh);
+  if (!num_boxes)
+    return;
+
+  bvh->items = (int*) malloc(sizeof(int) * num_boxes);
+  bvh->num_items = num_boxes;
+  for (size_t i = 0; i < num_boxes; i++)
+    bvh->items[i] = i;
+
+  // A tree with leaves of at least one item has at most 2n - 1 nodes
+  bvh->nodes = (bvh_node_t*) malloc(sizeof(bvh_node_t) * (2 * num_boxes - 1));
+  build_node(bvh, boxes, 0, num_boxes);
+}
+
+void bvh_refit(bvh_t* bvh, const aabb_t* boxes)
+{
+  // Children always come after their parent
+  for (size_t i = bvh->num_nodes; i-- > 0;)
+  {
+    bvh_node_t* node = bvh->nodes + i;
+    if (node->count)
+    {
+      aabb_t box = boxes[bvh->items[node->first]];
+      for (int j = 1; j < node->count; j++)
+        box = aabb_union(box, boxes[bvh->items[node->first + j]]);
+      node->box = box;
+    }
+    else
+    {
+      node->box = aabb_union(bvh->nodes[i + 1].box, bvh->nodes[node->right].box);
+    }
+  }
+}
+
+static bool visit_leaf(const bvh_t* bvh, const bvh_node_t* node, bvh_visit_t visit, void* data)
+{
+  for (int i = 0; i < node->count; i++)
+  {
+    if (visit(data, bvh->items[node->first + i]))
+      return true;
+  }
+  return false;
+}
+
+bool bvh_query(const bvh_t* bvh, aabb_t box, bvh_visit_t visit, void* data)
+{
+  if (!bvh->num_nodes)
+    return false;
+  
+  int stack[BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+  while (top)
+  {
+    int index = stack[--top];
+    const bvh_node_t* node = bvh->nodes + index;
+    if (!aabb_overlap(node->box, box))
+      continue;
+
+    if (node->count)
+    {
+      if (visit_leaf(bvh, node, visit, data))
+        return true;
+      continue;
+    }
+    stack[top++] = node->right;
+    stack[top++] = index + 1;
+  }
+  return false;
+}
+
+// Slab test, touching counts
+static bool segment_hits_box(point_t a, point_t b, aabb_t box)
+{
+  double t0 = 0;
+  double t1 = 1;
+  double start[2] = {a.x, a.y};
+  double delta[2] = {b.x - a.x, b.y - a.y};
+  double lo[2] = {box.min.x, box.min.y};
+  double hi[2] = {box.max.x, box.max.y};
+  
+  for (int axis = 0; axis < 2; axis++)
+  {
+    if (delta[axis] == 0)
+    {
+      if (start[axis] < lo[axis] || start[axis] > hi[axis])
+        return false;
+      continue;
+    }
+    
+    double ta = (lo[axis] - start[axis]) / delta[axis];
+    double tb = (hi[axis] - start[axis]) / delta[axis];
+    if (ta > tb)
+    {
+      double tmp = ta;
+      ta = tb;
+      tb = tmp;
+    }
+    if (ta > t0)
+      t0 = ta;
+    if (tb < t1)
+      t1 = tb;
+    if (t0 > t1)
+      return false;
+  }
+  return true;
+}
+
+bool bvh_query_segment(const bvh_t* bvh, point_t a, point_t b, bvh_visit_t visit, void* data)
+{
+  if (!bvh->num_nodes)
+    return false;
+  
+  int stack[BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+  while (top)
+  {
+    int index = stack[--top];
+    const bvh_node_t* node = bvh->nodes + index;
+    if (!segment_hits_box(a, b, node->box))
+      continue;
+
+    if (node->count)
+    {
+      if (visit_leaf(bvh, node, visit, data))
+        return true;
+      continue;
+    }
+    stack[top++] = node->right;
+    stack[top++] = index + 1;
+  }
+  return false;
+}
+
+static float box_distance2(point_t p, aabb_t box)
+{
+  float dx = 0;
+  float dy = 0;
+  if (p.x < box.min.x)
+    dx = box.min.x - p.x;
+  else if (p.x > box.max.x)
+    dx = p.x - box.max.x;
+  if (p.y < box.min.y)
+    dy = box.min.y - p.y;
+  else if (p.y > box.max.y)
+    dy = p.y - box.max.y;
+  return dx * dx + dy * dy;
+}
+
+int bvh_nearest(const bvh_t* bvh, point_t p, float max_d2,
+                bvh_distance_t distance, void* data, float* d2)
+{
+  int best = -1;
+  float best_d2 = max_d2;
+  if (!bvh->num_nodes)
+    return -1;
+  
+  int stack[BVH_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+  while (top)
+  {
+    int index = stack[--top];
+    const bvh_node_t* node = bvh->nodes + index;
+    if (box_distance2(p, node->box) >= best_d2)
+      continue;
+
+    if (node->count)
+    {
+      for (int i = 0; i < node->count; i++)
+      {
+        int item = bvh->items[node->first + i];
+        float d = distance(data, item, p);
+        if (d < best_d2)
+        {
+          best_d2 = d;
+          best = item;
+        }
+      }
+      continue;
+    }
+
+    // Descend into the closer child first so the bound tightens early
+    int left = index + 1;
+    int right = node->right;
+    if (box_distance2(p, bvh->nodes[left].box) < box_distance2(p, bvh->nodes[right].box))
+    {
+      stack[top++] = right;
+      stack[top++] = left;
+    }
+    else
+    {
+      stack[top++] = left;
+      stack[top++] = right;
+    }
+  }
+
+  if (d2 && best >= 0)
+    *d2 = best_d2;
+  return best;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "geom.h"
+
+// Bounding volume hierarchy over a set of boxes. Items are referred to by
+// their index in the box array the tree was built from. The nodes are
+// stored in depth first order, so the left child of an inner node is the
+// node right after it.
+
+#define BVH_LEAF_SIZE 4
+
+typedef struct
+{
+  aabb_t box;
+  int right; // inner nodes: index of the right child
+  int first; // leaves: first entry in items
+  int count; // leaves: number of items, 0 for inner nodes
+} bvh_node_t;
+
+typedef struct bvh_t
+{
+  bvh_node_t* nodes;
+  size_t num_nodes;
+  
+  int* items;
+  size_t num_items;
+} bvh_t;
+
+// Returns true to stop the traversal
+typedef bool (*bvh_visit_t)(void* data, int item);
+
+// Squared distance from p to an item
+typedef float (*bvh_distance_t)(void* data, int item, point_t p);
+
+void create_bvh(bvh_t* bvh);
+
+void delete_bvh(bvh_t* bvh);
+
+// Median split build, O(n log n)
+void bvh_build(bvh_t* bvh, const aabb_t* boxes, size_t num_boxes);
+
+// Recomputes the node bounds after the boxes moved, keeping the tree
+// shape. The box count must match the last build.
+void bvh_refit(bvh_t* bvh, const aabb_t* boxes);
+
+// Visits items whose box overlaps box. Returns true if visit stopped it.
+bool bvh_query(const bvh_t* bvh, aabb_t box, bvh_visit_t visit, void* data);
+
+// Visits items whose box is touched by the segment from a to b
+bool bvh_query_segment(const bvh_t* bvh, point_t a, point_t b, bvh_visit_t visit, void* data);
+
+// Closest item to p with a squared distance below max_d2, or -1. The
+// distance found is written to d2 if it is not NULL.
+int bvh_nearest(const bvh_t* bvh, point_t p, float max_d2,
+                bvh_distance_t distance, void* data, float* d2);
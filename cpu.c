@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(POLYDRAW_X86_KERNELS)
+#include <cpuid.h>
+#endif
+
+#include "cpu.h"
+
+static const char* level_names[] = {"scalar", "sse2", "sse4.1", "avx2", "avx512"};
+
+static pthread_once_t bind_once = PTHREAD_ONCE_INIT;
+static simd_level_t bound_level;
+static kernels_t bound_kernels;
+static const kernels_t* bound = NULL;
+
+#if defined(POLYDRAW_X86_KERNELS)
+static unsigned long long xgetbv(unsigned int index)
+{
+  unsigned int lo, hi;
+  __asm__ volatile("xgetbv" : "=a" (lo), "=d" (hi) : "c" (index));
+  return ((unsigned long long) hi << 32) | lo;
+}
+#endif
+
+simd_level_t cpu_simd_level(void)
+{
+  simd_level_t level = SIMD_SCALAR;
+
+#if defined(POLYDRAW_X86_KERNELS)
+  unsigned int a, b, c, d;
+  if (!__get_cpuid(1, &a, &b, &c, &d))
+    return level;
+  if (d & bit_SSE2)
+    level = SIMD_SSE2;
+  if ((c & bit_SSE4_1) && level == SIMD_SSE2)
+    level = SIMD_SSE41;
+
+  // Wider registers also need the OS to save them on a context switch
+  if (!(c & bit_OSXSAVE) || !(c & bit_AVX))
+    return level;
+  unsigned long long xcr0 = xgetbv(0);
+  if ((xcr0 & 0x6) != 0x6 || !__get_cpuid_count(7, 0, &a, &b, &c, &d))
+    return level;
+
+  if ((b & bit_AVX2) && level == SIMD_SSE41)
+    level = SIMD_AVX2;
+  if ((xcr0 & 0xe6) == 0xe6 && (b & bit_AVX512F) && (b & bit_AVX512BW) && level == SIMD_AVX2)
+    level = SIMD_AVX512;
+#endif
+
+  return level;
+}
+
+const char* simd_level_name(simd_level_t level)
+{
+  return level_names[level];
+}
+
+bool simd_kernels(simd_level_t level, kernels_t* kernels)
+{
+  if (level > cpu_simd_level())
+    return false;
+
+  kernels_scalar(kernels);
+#if defined(POLYDRAW_X86_KERNELS)
+  // None of the kernels gain from SSE4.1, it runs the SSE2 ones
+  if (level >= SIMD_SSE2)
+    kernels_sse2(kernels);
+  if (level >= SIMD_AVX2)
+    kernels_avx2(kernels);
+  if (level >= SIMD_AVX512)
+    kernels_avx512(kernels);
+#endif
+  return true;
+}
+
+static void bind_kernels(void)
+{
+  bound_level = cpu_simd_level();
+
+  const char* env = getenv("POLYDRAW_SIMD");
+  if (env)
+  {
+    int i = 0;
+    while (i <= SIMD_AVX512 && strcmp(env, level_names[i]))
+      i++;
+
+    if (i > SIMD_AVX512)
+      fprintf(stderr, "Unknown POLYDRAW_SIMD level %s.\n", env);
+    else if (i > bound_level)
+      fprintf(stderr, "POLYDRAW_SIMD level %s is not supported, using %s.\n",
+              env, level_names[bound_level]);
+    else
+      bound_level = (simd_level_t) i;
+  }
+
+  simd_kernels(bound_level, &bound_kernels);
+  __atomic_store_n(&bound, &bound_kernels, __ATOMIC_RELEASE);
+}
+
+simd_level_t simd_level(void)
+{
+  draw_kernels();
+  return bound_level;
+}
+
+const kernels_t* draw_kernels(void)
+{
+  const kernels_t* kernels = __atomic_load_n(&bound, __ATOMIC_ACQUIRE);
+  if (kernels)
+    return kernels;
+
+  pthread_once(&bind_once, bind_kernels);
+  return bound;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "kernels.h"
+
+// Instruction set levels, each including the ones below it
+typedef enum
+{
+  SIMD_SCALAR,
+  SIMD_SSE2,
+  SIMD_SSE41,
+  SIMD_AVX2,
+  SIMD_AVX512
+} simd_level_t;
+
+// Best level the CPU and OS support, from cpuid
+simd_level_t cpu_simd_level(void);
+
+// Level the kernels are bound to: cpu_simd_level(), unless POLYDRAW_SIMD
+// asks for a lower one (scalar, sse2, sse4.1, avx2 or avx512)
+simd_level_t simd_level(void);
+
+const char* simd_level_name(simd_level_t level);
+
+// Kernels for a level, false if the CPU or the build lacks it
+bool simd_kernels(simd_level_t level, kernels_t* kernels);
+
+// Kernels for simd_level(), bound on first use
+const kernels_t* draw_kernels(void);
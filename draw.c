@@ -1,28 +1,347 @@
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <stb/stretchy_buffer.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "draw.h"
+#include "cpu.h"
 
-void draw_point(pixel_display_t* display, pixel_t color, int x, int y, unsigned int radius)
+// Fill kernels
+//
+// The SIMD loops live in the kernel sets picked by cpu.c. Full-frame
+// clears above CLEAR_STREAM_THRESHOLD use non-temporal stores, since the
+// frame would not stay in cache anyway.
+
+#define CLEAR_STREAM_THRESHOLD (4 * 1024 * 1024)
+
+static void fill_pixels(pixel_t* dst, pixel_t color, size_t n)
+{
+  uint32_t c;
+  memcpy(&c, &color, sizeof(c));
+  draw_kernels()->fill((uint32_t*) dst, c, n);
+}
+
+static void stream_pixels(pixel_t* dst, pixel_t color, size_t n)
+{
+  uint32_t c;
+  memcpy(&c, &color, sizeof(c));
+  draw_kernels()->stream((uint32_t*) dst, c, n);
+}
+
+// Blend kernels
+//
+// Every blend mode comes down to dst = (add + dst * mul) >> 8 for each
+// channel, in 16 bits with saturation, where add and mul are worked out
+// once for a color and coverage. Alphas are scaled to 0..256 so that full
+// alpha keeps the color exactly. The SIMD kernels blend up to 16 pixels at
+// a time, and a blend that does not depend on dst is a plain fill.
+
+typedef struct
+{
+  bool opaque; // write color, dst does not matter
+  pixel_t color;
+  uint16_t add[4]; // pixel_t channel order
+  uint16_t mul[4];
+} blend_t;
+
+// x * y / 255 for 8 bit values
+static inline uint32_t mul_alpha(uint32_t x, uint32_t y)
+{
+  uint32_t a = (x * y) + 255;
+  return (a + (a >> 8)) >> 8;
+}
+
+static inline uint32_t blend_scale(uint32_t a)
+{
+  return a + (a >> 7);
+}
+
+static uint64_t blend_lanes(const uint16_t* v)
+{
+  return (uint64_t) v[0] | ((uint64_t) v[1] << 16) | ((uint64_t) v[2] << 32) | ((uint64_t) v[3] << 48);
+}
+
+static blend_t blend_setup(pixel_t color, int coverage, blend_mode_t mode)
+{
+  blend_t b;
+  uint8_t src[4];
+  memcpy(src, &color, sizeof(src));
+
+  // Alpha lane of the channel arrays
+  const int alpha = 3;
+  uint32_t a = blend_scale(mode == BLEND_REPLACE ? coverage : mul_alpha(coverage, color.a));
+  for (int c = 0; c < 4; c++)
+  {
+    b.add[c] = src[c] * a;
+    b.mul[c] = 256 - a;
+  }
+  
+  switch (mode)
+  {
+   case BLEND_REPLACE:
+     break;
+   case BLEND_OVER:
+     b.add[alpha] = 255 * a;
+     break;
+   case BLEND_ADD:
+     b.add[alpha] = 255 * a;
+     for (int c = 0; c < 4; c++)
+       b.mul[c] = 256;
+     break;
+   case BLEND_MULTIPLY:
+     for (int c = 0; c < alpha; c++)
+     {
+       b.add[c] = 0;
+       b.mul[c] = 256 - a + (((blend_scale(src[c]) * a) + 128) >> 8);
+     }
+     b.add[alpha] = 255 * a;
+     break;
+   case BLEND_PREMULTIPLIED:
+     for (int c = 0; c < 4; c++)
+       b.add[c] = src[c] * blend_scale(coverage);
+     break;
+  }
+
+  // Round rather than truncate the shift
+  uint8_t out[4];
+  for (int c = 0; c < 4; c++)
+  {
+    b.add[c] += 128;
+    out[c] = b.add[c] >> 8;
+  }
+  b.opaque = !blend_lanes(b.mul);
+  memcpy(&b.color, out, sizeof(out));
+  return b;
+}
+
+static void blend_span(pixel_t* dst, size_t n, const blend_t* b)
+{
+  if (b->opaque)
+  {
+    fill_pixels(dst, b->color, n);
+    return;
+  }
+
+  // Too short to be worth a call into the kernels
+  uint64_t add = blend_lanes(b->add);
+  uint64_t mul = blend_lanes(b->mul);
+  if (n < 4)
+  {
+    for (size_t i = 0; i < n; i++)
+      blend_pixel_scalar((uint8_t*) (dst + i), add, mul);
+    return;
+  }
+  draw_kernels()->blend((uint8_t*) dst, n, add, mul);
+}
+
+// One pixel of blend_span(blend_setup(color, coverage, mode)). Replace
+// and over are a lerp by one alpha, done two channels at a time.
+static inline void blend_pixel(pixel_t* dst, pixel_t color, int coverage, blend_mode_t mode)
+{
+  if (mode != BLEND_REPLACE && mode != BLEND_OVER)
+  {
+    blend_t b = blend_setup(color, coverage, mode);
+    blend_span(dst, 1, &b);
+    return;
+  }
+  
+  uint32_t a = blend_scale(mode == BLEND_REPLACE ? coverage : mul_alpha(coverage, color.a));
+  if (mode == BLEND_OVER)
+    color.a = 255;
+  
+  uint32_t s, d;
+  memcpy(&s, &color, sizeof(s));
+  memcpy(&d, dst, sizeof(d));
+  uint32_t rb = ((((s & 0x00ff00ff) * a) + ((d & 0x00ff00ff) * (256 - a)) + 0x00800080) >> 8) & 0x00ff00ff;
+  uint32_t ga = (((((s >> 8) & 0x00ff00ff) * a) + (((d >> 8) & 0x00ff00ff) * (256 - a)) + 0x00800080) >> 8) & 0x00ff00ff;
+  d = rb | (ga << 8);
+  memcpy(dst, &d, sizeof(d));
+}
+
+static void clip_span(pixel_display_t* display, const blend_t* blend, int y, int x0, int x1)
+{
+  rect_t clip = display->clip;
+  if (y < clip.y0 || y >= clip.y1)
+    return;
+  if (x0 < clip.x0)
+    x0 = clip.x0;
+  if (x1 > clip.x1)
+    x1 = clip.x1;
+  if (x0 >= x1)
+    return;
+  
+  blend_span(display->buf + x0 + (y * display->w), x1 - x0, blend);
+}
+
+void fill_span(pixel_display_t* display, pixel_t color, int y, int x0, int x1)
+{
+  blend_t blend = blend_setup(color, 255, display->blend);
+  clip_span(display, &blend, y, x0, x1);
+  
+  rect_t damage = {.x0 = x0, .y0 = y, .x1 = x1, .y1 = y + 1};
+  pixel_display_damage(display, damage);
+}
+
+// Circles
+//
+// Midpoint circles: a pixel (x, y) from the center is inside a circle of
+// radius r when x^2 + y^2 <= r^2 + r, the integer form of lying within
+// r + 1/2 of it. Moving away from the center row the half width of each
+// row only shrinks, so it is stepped down rather than taken from a square
+// root. Rows are drawn as clipped spans that never overlap, so blending
+// touches every pixel once.
+
+#define CIRCLE_STACK_ROWS 64
+
+typedef struct
+{
+  int radius;
+  int* widths; // half width of each row out from the center, radius + 2 of them
+  int stack[CIRCLE_STACK_ROWS];
+} circle_t;
+
+static void create_circle(circle_t* c, unsigned int radius)
+{
+  c->radius = radius;
+  c->widths = c->stack;
+  if (radius + 2 > CIRCLE_STACK_ROWS)
+    c->widths = (int*) malloc(sizeof(int) * (radius + 2));
+
+  int64_t limit = ((int64_t) radius * radius) + radius;
+  int64_t w = radius;
+  for (int64_t y = 0; y <= radius; y++)
+  {
+    while ((w * w) + (y * y) > limit)
+      w--;
+    c->widths[y] = (int) w;
+  }
+  c->widths[radius + 1] = -1;
+}
+
+static void delete_circle(circle_t* c)
+{
+  if (c->widths != c->stack)
+    free(c->widths);
+  c->widths = NULL;
+}
+
+static rect_t circle_rect(const circle_t* c, int x, int y)
+{
+  rect_t r = {.x0 = x - c->radius, .y0 = y - c->radius,
+              .x1 = x + c->radius + 1, .y1 = y + c->radius + 1};
+  return r;
+}
+
+// Outlines keep the pixels with a neighbour outside the circle, which can
+// only be the next row out or the ends of their own row
+static void stamp_circle(pixel_display_t* display, const blend_t* blend,
+                         const circle_t* c, int x, int y, bool outline)
 {
-  if ((x < 0 || x > display->w) || (y < 0 || y > display->h))
+  rect_t clip = display->clip;
+  if (!rect_overlap(circle_rect(c, x, y), clip))
     return;
   
-  for (int i = x - radius; i <= x + radius; i++)
+  int dy0 = clip.y0 - y > -c->radius ? clip.y0 - y : -c->radius;
+  int dy1 = clip.y1 - 1 - y < c->radius ? clip.y1 - 1 - y : c->radius;
+  for (int dy = dy0; dy <= dy1; dy++)
   {
-    for (int j = y - radius; j <= y + radius; j++)
+    int row = abs(dy);
+    int w = c->widths[row];
+    int inner = c->widths[row + 1] + 1;
+    if (!outline || inner <= 0)
+      clip_span(display, blend, y + dy, x - w, x + w + 1);
+    else
     {
-      if ((i > 0 && i < display->w) && (j > 0 && j < display->h))
-        display->buf[i + (j * display->w)] = color;
+      inner = inner < w ? inner : w;
+      clip_span(display, blend, y + dy, x - w, x - inner + 1);
+      clip_span(display, blend, y + dy, x + inner, x + w + 1);
     }
   }
 }
 
+static void draw_circle_shape(pixel_display_t* display, pixel_t color, int x, int y,
+                              unsigned int radius, bool outline)
+{
+  circle_t c;
+  create_circle(&c, radius);
+  blend_t blend = blend_setup(color, 255, display->blend);
+  stamp_circle(display, &blend, &c, x, y, outline);
+  pixel_display_damage(display, circle_rect(&c, x, y));
+  delete_circle(&c);
+}
+
+void fill_circle(pixel_display_t* display, pixel_t color, int x, int y, unsigned int radius)
+{
+  draw_circle_shape(display, color, x, y, radius, false);
+}
+
+void draw_circle(pixel_display_t* display, pixel_t color, int x, int y, unsigned int radius)
+{
+  draw_circle_shape(display, color, x, y, radius, true);
+}
+
+void draw_point(pixel_display_t* display, pixel_t color, int x, int y, unsigned int radius)
+{
+  fill_circle(display, color, x, y, radius);
+}
+
+void draw_points(pixel_display_t* display, pixel_t color, const point_t* points, size_t num_points,
+                 unsigned int radius)
+{
+  if (!num_points)
+    return;
+  
+  circle_t c;
+  create_circle(&c, radius);
+  blend_t blend = blend_setup(color, 255, display->blend);
+  
+  rect_t damage = {0, 0, 0, 0};
+  for (size_t i = 0; i < num_points; i++)
+  {
+    int x = (int) points[i].x;
+    int y = (int) points[i].y;
+    stamp_circle(display, &blend, &c, x, y, false);
+    damage = rect_union(damage, circle_rect(&c, x, y));
+  }
+  pixel_display_damage(display, damage);
+  
+  delete_circle(&c);
+}
+
 void clear_display(pixel_display_t* display, pixel_t color)
 {
-  for (int i = 0; i < display->w * display->h; i++)
+  rect_t clip = display->clip;
+  pixel_display_damage(display, clip);
+  
+  size_t n = display->w * display->h;
+  if (clip.x0 > 0 || clip.y0 > 0 || clip.x1 < (int) display->w || clip.y1 < (int) display->h)
   {
-    display->buf[i] = color;
+    for (int y = clip.y0; y < clip.y1; y++)
+      fill_pixels(display->buf + clip.x0 + (y * display->w), color, clip.x1 - clip.x0);
   }
+  else if (n * sizeof(pixel_t) >= CLEAR_STREAM_THRESHOLD)
+    stream_pixels(display->buf, color, n);
+  else
+    fill_pixels(display->buf, color, n);
+}
+
+void copy_display(pixel_display_t* display, const pixel_display_t* src, rect_t rect)
+{
+  rect_t src_rect = {0, 0, src->w, src->h};
+  rect = rect_intersect(rect_intersect(rect, display->clip), src_rect);
+  if (rect_is_empty(rect))
+    return;
+  pixel_display_damage(display, rect);
+
+  size_t n = (rect.x1 - rect.x0) * sizeof(pixel_t);
+  for (int y = rect.y0; y < rect.y1; y++)
+    memcpy(display->buf + rect.x0 + (y * display->w), src->buf + rect.x0 + (y * src->w), n);
 }
 
 int sign(int x)
@@ -37,220 +356,1451 @@ int swap(int* x, int* y)
   *y = *x;
 }
 
+// Line clipping
+//
+// Lines are clipped to the steps that land inside the clip rect before
+// stepping, so the loop itself has no bounds checks. Stepping k times along
+// the major axis from an error term of d0 = b - (a / 2), where a and b are
+// twice the major and minor lengths, leaves the error at d0 + kb - ma after
+// m minor steps, and it stays within (b - a, b]. That pins m down:
+//
+//   m(k) = ceil((d0 + (k - 1)b) / a)
+//
+// and the first step with m(k) >= M is floor(((M - 1)a - d0) / b) + 2, so
+// both ends of the clipped line and its error term come out exactly as if
+// it had been stepped from the start.
+
+typedef struct
+{
+  int pos;
+  int incr;
+  int lo, hi;
+} line_axis_t;
+
+static int64_t floor_div(int64_t n, int64_t d)
+{
+  int64_t q = n / d;
+  return q - ((n % d) < 0);
+}
+
+// Step counts [*s0, *s1] along an axis that stay within [lo, hi)
+static void line_axis_steps(const line_axis_t* axis, int64_t* s0, int64_t* s1)
+{
+  if (axis->incr > 0)
+  {
+    *s0 = (int64_t) axis->lo - axis->pos;
+    *s1 = (int64_t) axis->hi - 1 - axis->pos;
+  }
+  else if (axis->incr < 0)
+  {
+    *s0 = (int64_t) axis->pos - axis->hi + 1;
+    *s1 = (int64_t) axis->pos - axis->lo;
+  }
+  else
+  {
+    bool inside = axis->pos >= axis->lo && axis->pos < axis->hi;
+    *s0 = inside ? 0 : 1;
+    *s1 = 0;
+  }
+}
+
+static int64_t line_first_step(int64_t m, int64_t a, int64_t b, int64_t d0)
+{
+  return floor_div(((m - 1) * a) - d0, b) + 2;
+}
+
 void draw_line(pixel_display_t* display, pixel_t color,
                int x1, int y1, int x2, int y2)
 {
-  size_t w = display->w;
-  size_t h = display->h;
+  if (display->quality == QUALITY_ANTIALIASED)
+  {
+    draw_line_aa(display, color, x1, y1, x2, y2);
+    return;
+  }
+
+  rect_t damage = {.x0 = x1 < x2 ? x1 : x2, .y0 = y1 < y2 ? y1 : y2,
+                   .x1 = (x1 < x2 ? x2 : x1) + 1, .y1 = (y1 < y2 ? y2 : y1) + 1};
+  pixel_display_damage(display, damage);
+
+  // Lines have always left row and column 0 alone
+  rect_t clip = display->clip;
+  line_axis_t x = {.pos = x1, .incr = sign(x2 - x1), .lo = clip.x0 > 1 ? clip.x0 : 1, .hi = clip.x1};
+  line_axis_t y = {.pos = y1, .incr = sign(y2 - y1), .lo = clip.y0 > 1 ? clip.y0 : 1, .hi = clip.y1};
+  int64_t x_len = llabs((int64_t) x2 - x1);
+  int64_t y_len = llabs((int64_t) y2 - y1);
+
+  // The end point is not drawn, so a line of n steps along its major axis
+  // draws n pixels
+  bool x_major = x_len > y_len;
+  line_axis_t* major = x_major ? &x : &y;
+  line_axis_t* minor = x_major ? &y : &x;
+  int64_t n = x_major ? x_len : y_len;
+  int64_t minor_len = x_major ? y_len : x_len;
+  if (n == 0)
+    return;
   
-  int dx = x2 - x1;
-  int dy = y2 - y1;
+  int64_t a = 2 * n;
+  int64_t b = 2 * minor_len;
+  int64_t d0 = b - n;
 
-  int x_derr = 2 * abs(dx);
-  int y_derr = 2 * abs(dy);
+  int64_t k0, k1, m0, m1;
+  line_axis_steps(major, &k0, &k1);
+  line_axis_steps(minor, &m0, &m1);
+  k0 = k0 > 0 ? k0 : 0;
+  k1 = k1 < n - 1 ? k1 : n - 1;
+  m0 = m0 > 0 ? m0 : 0;
+  m1 = m1 < minor_len ? m1 : minor_len;
+  if (k0 > k1 || m0 > m1)
+    return;
+  
+  if (b > 0)
+  {
+    int64_t first = line_first_step(m0, a, b, d0);
+    int64_t last = line_first_step(m1 + 1, a, b, d0) - 1;
+    k0 = first > k0 ? first : k0;
+    k1 = last < k1 ? last : k1;
+    if (k0 > k1)
+      return;
+  }
 
-  int x_incr = sign(dx);
-  int y_incr = sign(dy);
+  int64_t m = b > 0 ? -floor_div(-(d0 + ((k0 - 1) * b)), a) : 0;
+  int64_t d = d0 + (k0 * b) - (m * a);
+  major->pos += (int) (k0 * major->incr);
+  minor->pos += (int) (m * minor->incr);
 
-  if (abs(dx) > abs(dy))
+  ptrdiff_t stride = display->w;
+  ptrdiff_t major_step = x_major ? x.incr : y.incr * stride;
+  ptrdiff_t minor_step = x_major ? y.incr * stride : x.incr;
+  pixel_t* dst = display->buf + x.pos + (y.pos * stride);
+  blend_t blend = blend_setup(color, 255, display->blend);
+  
+  for (int64_t k = k0; k <= k1; k++)
   {
-    int d = (2 * abs(dy)) - abs(dx);
-    int y = y1;
-    for (int x = x1; x != x2; x += x_incr)
+    if (blend.opaque)
+      *dst = blend.color;
+    else
+      blend_span(dst, 1, &blend);
+    
+    if (d > 0)
     {
-      draw_point(display, color, x, y, 0);
-      
-      if (d > 0)
-      {
-        y += y_incr;
-        d -= x_derr;
-      }
-      d += y_derr;
+      dst += minor_step;
+      d -= a;
     }
+    d += b;
+    dst += major_step;
   }
-  else
+}
+
+// Anti-aliased lines
+//
+// Wu's algorithm: the line is stepped one pixel at a time along its major
+// axis with the minor coordinate in 16.16 fixed point, and each step is
+// shared between the two pixels straddling the line by their distance to
+// it. Pixel centers sit on integer coordinates.
+
+#define AA_FRAC_BITS 16
+
+// Lines are first clipped to the display grown by this, in double, so the
+// stepping starts close to the visible part and no coordinate overflows an
+// int. It goes by the display rather than the clip rect, so the tiles of a
+// raster all step the same line.
+#define AA_LINE_GUARD_BAND 64
+
+static int aa_coverage(float c)
+{
+  if (c <= 0)
+    return 0;
+  if (c >= 1)
+    return 255;
+  return (int) ((c * 255) + 0.5f);
+}
+
+// Liang-Barsky: clips the segment to the box, false if
+// nothing of it is left
+static bool clip_line(double* x1, double* y1, double* x2, double* y2,
+                      double box_x0, double box_y0, double box_x1, double box_y1)
+{
+  double dx = *x2 - *x1;
+  double dy = *y2 - *y1;
+  double p[4] = {-dx, dx, -dy, dy};
+  double q[4] = {*x1 - box_x0, box_x1 - *x1, *y1 - box_y0, box_y1 - *y1};
+  double t0 = 0;
+  double t1 = 1;
+  for (int i = 0; i < 4; i++)
   {
-    int d = (2 * abs(dx)) - abs(dy);
-    int x = x1;
-    for (int y = y1; y != y2; y += y_incr)
+    if (p[i] == 0)
     {
-      draw_point(display, color, x, y, 0);
-      
-      if (d > 0)
-      {
-        x += x_incr;
-        d -= y_derr;
-      }
-      d += x_derr;
+      if (q[i] < 0)
+        return false;
+      continue;
     }
+
+    double t = q[i] / p[i];
+    if (p[i] < 0 && t > t0)
+      t0 = t;
+    else if (p[i] > 0 && t < t1)
+      t1 = t;
+  }
+  if (t0 > t1)
+    return false;
+
+  // Only ends that were cut move, lines inside the box are left exact
+  double ox = *x1;
+  double oy = *y1;
+  if (t1 < 1)
+  {
+    *x2 = ox + (t1 * dx);
+    *y2 = oy + (t1 * dy);
+  }
+  if (t0 > 0)
+  {
+    *x1 = ox + (t0 * dx);
+    *y1 = oy + (t0 * dy);
+  }
+  return true;
+}
+
+void draw_line_aa(pixel_display_t* display, pixel_t color,
+                  float x1, float y1, float x2, float y2)
+{
+  if (!isfinite(x1) || !isfinite(y1) || !isfinite(x2) || !isfinite(y2))
+    return;
+
+  double cx1 = x1, cy1 = y1, cx2 = x2, cy2 = y2;
+  if (!clip_line(&cx1, &cy1, &cx2, &cy2, -AA_LINE_GUARD_BAND, -AA_LINE_GUARD_BAND,
+                 (double) display->w + AA_LINE_GUARD_BAND, (double) display->h + AA_LINE_GUARD_BAND))
+    return;
+  x1 = (float) cx1;
+  y1 = (float) cy1;
+  x2 = (float) cx2;
+  y2 = (float) cy2;
+
+  rect_t damage = {.x0 = (int) floorf(x1 < x2 ? x1 : x2) - 1, .y0 = (int) floorf(y1 < y2 ? y1 : y2) - 1,
+                   .x1 = (int) floorf(x1 < x2 ? x2 : x1) + 2, .y1 = (int) floorf(y1 < y2 ? y2 : y1) + 2};
+  pixel_display_damage(display, damage);
+  if (!rect_overlap(damage, display->clip))
+    return;
+
+  // Step along x, swapping the axes for steep lines
+  bool steep = fabsf(y2 - y1) > fabsf(x2 - x1);
+  float t;
+  if (steep)
+  {
+    t = x1; x1 = y1; y1 = t;
+    t = x2; x2 = y2; y2 = t;
+  }
+  if (x1 > x2)
+  {
+    t = x1; x1 = x2; x2 = t;
+    t = y1; y1 = y2; y2 = t;
+  }
+
+  float dx = x2 - x1;
+  float gradient = dx > 0 ? (y2 - y1) / dx : 0;
+
+  // The end pixels are only partly covered along the major axis
+  int xs = (int) floorf(x1 + 0.5f);
+  int xe = (int) floorf(x2 + 0.5f);
+  int start_weight = aa_coverage(xs + 0.5f - x1);
+  int end_weight = aa_coverage(x2 - (xe - 0.5f));
+  if (xs == xe)
+    start_weight = end_weight = aa_coverage(dx);
+
+  int64_t y0 = llrintf((y1 + (gradient * (xs - x1))) * (1 << AA_FRAC_BITS));
+  int32_t step = (int32_t) lrintf(gradient * (1 << AA_FRAC_BITS));
+  
+  // Clip rect and pixel strides along the major and minor axes
+  rect_t clip = display->clip;
+  int major_lo = steep ? clip.y0 : clip.x0;
+  int major_hi = steep ? clip.y1 : clip.x1;
+  int minor_lo = steep ? clip.x0 : clip.y0;
+  int minor_hi = steep ? clip.x1 : clip.y1;
+  ptrdiff_t major_step = steep ? display->w : 1;
+  ptrdiff_t minor_step = steep ? 1 : display->w;
+  pixel_t* buf = display->buf;
+  blend_mode_t mode = display->blend;
+
+  // Clip the steps to those touching the clip rect, one of the pixel pair
+  // may still fall outside it at the minor ends
+  int64_t k0 = (major_lo > xs ? major_lo : xs) - (int64_t) xs;
+  int64_t k1 = (major_hi - 1 < xe ? major_hi - 1 : xe) - (int64_t) xs;
+  int64_t y_lo = (int64_t) (minor_lo - 1) * (1 << AA_FRAC_BITS) - y0;
+  int64_t y_hi = ((int64_t) minor_hi * (1 << AA_FRAC_BITS)) - 1 - y0;
+  if (step > 0)
+  {
+    int64_t first = -floor_div(-y_lo, step);
+    int64_t last = floor_div(y_hi, step);
+    k0 = first > k0 ? first : k0;
+    k1 = last < k1 ? last : k1;
+  }
+  else if (step < 0)
+  {
+    int64_t first = -floor_div(y_hi, -step);
+    int64_t last = floor_div(-y_lo, -step);
+    k0 = first > k0 ? first : k0;
+    k1 = last < k1 ? last : k1;
+  }
+  else if (y_lo > 0 || y_hi < 0)
+    return;
+
+  int32_t y = (int32_t) (y0 + (k0 * step));
+  for (int x = xs + (int) k0; x <= xs + k1; x++, y += step)
+  {
+    int weight = x == xs ? start_weight : (x == xe ? end_weight : 255);
+    int iy = y >> AA_FRAC_BITS;
+    int frac = (y >> (AA_FRAC_BITS - 8)) & 0xff;
+    pixel_t* dst = buf + (x * major_step) + (iy * minor_step);
+    
+    if (iy >= minor_lo)
+      blend_pixel(dst, color, (((255 - frac) * weight) + 255) >> 8, mode);
+    if (iy + 1 < minor_hi)
+      blend_pixel(dst + minor_step, color, ((frac * weight) + 255) >> 8, mode);
   }
 }
 
 void draw_polygon_bounds(pixel_display_t* display, pixel_t color, polygon_t* p)
 {
+  bool aa = display->quality == QUALITY_ANTIALIASED;
   for (int i = 0; i < p->num_edges; i++)
   {
     point_t* point = p->points + i;
     point_t* next = p->points + ((i +  1) % p->num_points);
-    
-    draw_line(display, color,
-              point->x, point->y,
-              next->x, next->y);
+
+    // Anti-aliased outlines keep the subpixel vertex positions
+    if (aa)
+      draw_line_aa(display, color, point->x, point->y, next->x, next->y);
+    else
+      draw_line(display, color,
+                point->x, point->y,
+                next->x, next->y);
   }
 }
 
 void draw_polygon_points(pixel_display_t* display, pixel_t color, polygon_t* p, unsigned int radius)
 {
-  for (int i = 0; i < p->num_points; i++)
-  {
-    point_t* point = p->points + i;
-    draw_point(display, color,
-               point->x, point->y,
-               radius);
-  }
+  draw_points(display, color, p->points, p->num_points, radius);
 }
 
 
+// Scanline fill
+//
+// Edges are taken from the polygon's edge table, sorted by the first
+// scanline they cross, and moved into an active edge list that is kept
+// sorted by x. Walking the list left to right sums the winding of the
+// edges crossed, and the fill rule decides which gaps are inside.
+//
+// A monotone outline crosses the rows between its vertices exactly twice,
+// once going down and once going up, so either fill rule fills the gap
+// between the two crossings. Those rows skip the sorting and the winding
+// and walk the pair of edges until one ends or passes through a vertex.
+
 typedef struct
 {
   int x;
-  int n;
+  int edge;
   int vert_index;
 } x_entry_t;
 
-int x_entry_comparator(const void* p_x1, const void* p_x2)
+#define FILL_X_EPSILON 1e-7
+
+// Polygons reaching further than this past the display are clipped to the
+// display grown by it before being scanned, so a zoomed in polygon only
+// costs its visible part. The band keeps the edges that clipping adds well
+// clear of the pixels that get drawn. It goes by the display rather than
+// the clip rect so the tiles of a raster all fill the same polygon.
+#define FILL_GUARD_BAND 64
+
+// Intersections are truncated, so snap values that drifted off an exact
+// integer while stepping back onto it. Only a value just short of the
+// next integer out from zero truncates differently when snapped, which
+// saves a call to round. The differences are exact.
+static int fill_x_trunc(double x)
 {
-  x_entry_t* x1 = (x_entry_t*) p_x1;
-  x_entry_t* x2 = (x_entry_t*) p_x2;
-  
-  if (x1->x < x2->x)
-    return -1;
-  else if (x1->x == x2->x)
-    return 0;
-  else
-    return 1;
+  int t = (int) x;
+  double f = x - t;
+  if (f - 1 > -FILL_X_EPSILON)
+    return t + 1;
+  if (f + 1 < FILL_X_EPSILON)
+    return t - 1;
+  return t;
 }
 
-void scan_fill(pixel_display_t* display, pixel_t color, polygon_t* p)
-{  
-  if (p->complex)
-    return;
-  if (p->num_points < 3)
-    return;
-  if (!p->closed)
-    return;
+static int fill_clamp(double v, int lo, int hi)
+{
+  if (v < lo)
+    return lo;
+  if (v > hi)
+    return hi;
+  return (int) v;
+}
+
+static bool x_entry_less(const x_entry_t* a, const x_entry_t* b, const edge_t* edges)
+{
+  return a->x < b->x
+    || (a->x == b->x && edges[a->edge].index < edges[b->edge].index);
+}
+
+static int y_dir(point_t* from, point_t* to)
+{
+  return (to->y > from->y) - (to->y < from->y);
+}
 
-  int max_y = 0;
-  int min_y = display->h;
-  for (int i = 0; i < p->num_points; i++)
+// Direction of the edge leading into a vertex. If the vertex tails a flat
+// edge, use the diff from the last edge that was not flat.
+static int vertex_in_diff(polygon_t* p, int v)
+{
+  point_t* u1 = p->points + v;
+  int prev = v;
+  int diff = 0;
+  do
   {
-    point_t* point = p->points + i;
-    if (point->y > max_y)
-      max_y = point->y;
-    if (point->y < min_y)
-      min_y = point->y;
-  }
+    prev = (prev + p->num_points - 1) % p->num_points;
+    diff = y_dir(p->points + prev, u1);
+  } while (diff == 0 && prev != v);
+  return diff;
+}
 
-  x_entry_t* x_intersections = (x_entry_t*) malloc(sizeof(x_entry_t) * p->num_edges);
-  
-  for (int y = min_y;  y < max_y; y++)
-  {   
-    point_t p1;
-    p1.x = -display->w;
-    p1.y = y;
-    
-    point_t p2;
-    p2.x = 2 * display->w;
-    p2.y = y;
+// Winding change from crossing an active edge. A vertex lying on the
+// scanline only counts if the outline passes through it, not at a local
+// extreme or where a flat edge starts.
+static int active_winding(polygon_t* p, const edge_t* edge, const x_entry_t* entry)
+{
+  point_t* u1 = p->points + edge->index;
+  point_t* u2 = p->points + ((edge->index + 1) % p->num_points);
+  int dir = y_dir(u1, u2);
+  if (entry->vert_index < 0 || dir == 0)
+    return dir;
+  return vertex_in_diff(p, entry->vert_index) == dir ? dir : 0;
+}
 
-    size_t num_x = 0;
-    for (int i = 0; i < p->num_edges; i++)
-    {
-      // edge 1
-      point_t* u0 = p->points + ((i + p->num_points - 1) % p->num_points); // last point
-      point_t* u1 = p->points + i;
-      point_t* u2 = p->points + ((i + 1) % p->num_points);
+static bool fill_rule_inside(int winding, fill_rule_t rule)
+{
+  return rule == FILL_NON_ZERO ? winding != 0 : (winding & 1);
+}
 
-      // horizontal edges
-      if (u1->y == u2->y)
-      {
-        if (u1->y == y)
-        {
-          x_entry_t new_entry;
-          new_entry.vert_index = i;
-          new_entry.x = u1->x;
+static int active_x(polygon_t* p, const edge_t* edge, int y)
+{
+  point_t* u1 = p->points + edge->index;
+  if (edge->flat)
+    return (int) u1->x;
+  return fill_x_trunc(u1->x + ((y - u1->y) * edge->dxdy)) + 1;
+}
 
-          x_intersections[num_x] = new_entry;
-          num_x += 1;
-        }
-        continue;
-      }
-      
-      if (!((u1->y < y && u2->y > y)
-            || (u1->y > y && u2->y < y)
-            || u1->y == y))
-        continue;
-      
-      // Find intersection
-      x_entry_t new_entry;
-      new_entry.vert_index = -1;
-      int x = (int) (((double) ((y - u1->y) * (u2->x - u1->x)) / (double) (u2->y - u1->y)) + u1->x);
-      new_entry.x = x + 1;
-        
-      if (u1->x == x
-          && u1->y == y)
-      {
-        new_entry.vert_index = i;
-      }
-      x_intersections[num_x] = new_entry;
-      num_x++;
-    }
-    
-    qsort((void*) x_intersections, num_x, sizeof(x_entry_t), x_entry_comparator);
+// Sorts the active edges by their intersection with row y and emits the
+// gaps the fill rule puts inside
+static void scan_row(polygon_t* p, const edge_t* edges, x_entry_t* active, size_t num_x, int y,
+                     fill_rule_t rule, span_func_t emit, void* data)
+{
+  // Intersections are computed from the row alone rather than stepped,
+  // so any range of rows comes out the same as part of a full fill.
+  // Insertion sort, the order rarely changes between scanlines.
+  for (size_t i = 0; i < num_x; i++)
+  {
+    int e = active[i].edge;
+    const edge_t* edge = edges + e;
+    point_t* u1 = p->points + edge->index;
 
-    int last_diff_1;
-    int n = 0;
-    for (int i = 0; i < num_x; i++)
+    x_entry_t entry;
+    entry.edge = e;
+    entry.vert_index = (edge->flat || u1->y == y) ? edge->index : -1;
+    entry.x = active_x(p, edge, y);
+
+    size_t j = i;
+    while (j > 0 && x_entry_less(&entry, active + j - 1, edges))
     {
-      if (i == num_x -1)
-        continue;      
-      if (x_intersections[i].vert_index >= 0)
-      {
-        int v = x_intersections[i].vert_index;
-        point_t* u0 = p->points + ((v + p->num_points - 1) % p->num_points);
-        point_t* u1 = p->points + v;
-        point_t* u2 = p->points + ((v + p->num_points + 1) % p->num_points);
-      
-        int diff_1 = sign(u1->y - u0->y);
-        int diff_2 = sign(u1->y - u2->y);
-        
-        if (i == 0)
-          last_diff_1 = diff_1;
-
-        if (diff_1 == 0) // If the vertex tails a flat edge, use the diff from the last edge
-          diff_1 = last_diff_1;
-        
-        if (diff_1 == diff_2
-            || diff_2 == 0) // If the vertex is a local maximum or leads a flat edge, do not change the parity
-        {
-          n += 2;
-        }
-        else
-        {
-          n += 1;
-        }
-        
-        last_diff_1 = diff_1;
-      }
-      else
-      {
-        n++;
-      }
-      
-      if (n % 2)
-        draw_line(display, color, x_intersections[i].x, y, x_intersections[i + 1].x, y);
+      active[j] = active[j - 1];
+      j--;
     }
+    active[j] = entry;
   }
 
-  free(x_intersections);
+  int winding = 0;
+  for (int i = 0; i + 1 < num_x; i++)
+  {
+    winding += active_winding(p, edges + active[i].edge, active + i);
+    if (fill_rule_inside(winding, rule))
+      emit(data, y, active[i].x, active[i + 1].x);
+  }
+}
+
+// Emits rows from y up to y_end while the two edges of a monotone outline
+// stay the only active ones, returning the row it stopped at
+static int scan_edge_pair(polygon_t* p, const edge_t* a, const edge_t* b, int y, int y_end,
+                          span_func_t emit, void* data)
+{
+  if (a->flat || b->flat)
+    return y;
+  if (a->y_end < y_end)
+    y_end = (int) a->y_end;
+  if (b->y_end < y_end)
+    y_end = (int) b->y_end;
+
+  // Rows through a vertex need the winding rules of scan_row. Same sums
+  // as active_x, with the edges held in locals across the emit calls.
+  point_t ua = p->points[a->index];
+  point_t ub = p->points[b->index];
+  double dxa = a->dxdy;
+  double dxb = b->dxdy;
+  for (; y < y_end && ua.y != y && ub.y != y; y++)
+  {
+    int xa = fill_x_trunc(ua.x + ((y - ua.y) * dxa)) + 1;
+    int xb = fill_x_trunc(ub.x + ((y - ub.y) * dxb)) + 1;
+    if (xa <= xb)
+      emit(data, y, xa, xb);
+    else
+      emit(data, y, xb, xa);
+  }
+  return y;
+}
+
+void scan_fill_rows(polygon_t* p, int y_lo, int y_hi, fill_rule_t rule,
+                    span_func_t emit, void* data)
+{
+  size_t num_edges;
+  const edge_t* edges = polygon_edge_table(p, &num_edges);
+  if (!num_edges)
+    return;
+  
+  bool monotone = polygon_is_monotone(p);
+  x_entry_t* active = (x_entry_t*) malloc(sizeof(x_entry_t) * num_edges);
+
+  size_t next_edge = 0;
+  size_t num_active = 0;
+  for (int y = y_lo; y < y_hi; y++)
+  {
+    // Drop finished edges
+    size_t num_x = 0;
+    for (size_t i = 0; i < num_active; i++)
+    {
+      int e = active[i].edge;
+      if (edges[e].y_end <= y)
+        continue;
+      active[num_x++].edge = e;
+    }
+
+    // Add edges starting on this scanline, or above the first one
+    for (; next_edge < num_edges && edges[next_edge].y_start <= y; next_edge++)
+    {
+      if (edges[next_edge].y_end <= y)
+        continue;
+      active[num_x++].edge = next_edge;
+    }
+    num_active = num_x;
+
+    if (monotone && num_x == 2)
+    {
+      int y_end = y_hi;
+      if (next_edge < num_edges && edges[next_edge].y_start < y_end)
+        y_end = (int) edges[next_edge].y_start;
+      
+      int next_y = scan_edge_pair(p, edges + active[0].edge, edges + active[1].edge, y, y_end, emit, data);
+      if (next_y > y)
+      {
+        y = next_y - 1;
+        continue;
+      }
+    }
+    scan_row(p, edges, active, num_x, y, rule, emit, data);
+  }
+
+  free(active);
+}
+
+polygon_t* scan_fill_polygon(pixel_display_t* display, polygon_t* p)
+{
+  aabb_t box;
+  box.min.x = -FILL_GUARD_BAND;
+  box.min.y = -FILL_GUARD_BAND;
+  box.max.x = (float) display->w + FILL_GUARD_BAND;
+  box.max.y = (float) display->h + FILL_GUARD_BAND;
+
+  // Polygons that miss the display altogether are culled by their bounds
+  // anyway, do not clip them down to nothing first
+  aabb_t b = polygon_bounds(p);
+  if (b.max.x < box.min.x || b.max.y < box.min.y || b.min.x > box.max.x || b.min.y > box.max.y)
+    return p;
+  return polygon_clipped(p, box);
+}
+
+bool scan_fill_range(pixel_display_t* display, polygon_t* p, int* y_lo, int* y_hi)
+{
+  if (p->num_points < 3)
+    return false;
+  if (!p->closed)
+    return false;
+
+  // Cull polygons that miss the clip rect, and do not scan the rows
+  // outside it since they are never written
+  rect_t clip = display->clip;
+  if (!rect_overlap(scan_fill_rect(p), clip))
+    return false;
+  aabb_t bounds = polygon_bounds(p);
+  *y_lo = fill_clamp(bounds.min.y, clip.y0, clip.y1);
+  *y_hi = fill_clamp(bounds.max.y, clip.y0, clip.y1);
+  if (*y_lo >= *y_hi)
+    return false;
+
+  size_t num_edges;
+  polygon_edge_table(p, &num_edges);
+  polygon_is_monotone(p);
+  return true;
+}
+
+rect_t scan_fill_rect(polygon_t* p)
+{
+  // Spans end one past the truncated intersection, allow for that
+  aabb_t bounds = polygon_bounds(p);
+  rect_t r;
+  r.x0 = fill_clamp(floor(bounds.min.x) - 1, INT_MIN / 2, INT_MAX / 2);
+  r.y0 = fill_clamp(floor(bounds.min.y), INT_MIN / 2, INT_MAX / 2);
+  r.x1 = fill_clamp(floor(bounds.max.x) + 3, INT_MIN / 2, INT_MAX / 2);
+  r.y1 = fill_clamp(floor(bounds.max.y) + 1, INT_MIN / 2, INT_MAX / 2);
+  return r;
+}
+
+// Span cache
+//
+// A polygon keeps the spans of its last fill by each rule, covering every
+// row of the display and clipped to its width, so the clip rect of a fill
+// does not matter. They are tagged with the polygon version and display
+// size they were made for.
+
+#define SPAN_BAND_ROWS 64
+
+typedef struct
+{
+  span_t* spans;
+  int w;
+} span_cache_target_t;
+
+static void emit_cached_span(void* data, int y, int x0, int x1)
+{
+  span_cache_target_t* target = (span_cache_target_t*) data;
+  x0 = x0 > 0 ? x0 : 0;
+  x1 = x1 < target->w ? x1 : target->w;
+  if (x0 >= x1)
+    return;
+
+  span_t span = {.y = y, .x0 = x0, .x1 = x1};
+  sb_push(target->spans, span);
+}
+
+static bool span_cache_valid(const span_cache_t* cache, pixel_display_t* display, polygon_t* p)
+{
+  return cache->version == p->version && cache->w == display->w && cache->h == display->h;
+}
+
+// Empties the cache and tags it as up to date, returning the rows to scan
+// into it. Updates the polygon's caches, scanning only reads them.
+static void span_cache_reset(span_cache_t* cache, pixel_display_t* display, polygon_t* p,
+                             int* y_lo, int* y_hi)
+{
+  if (cache->spans)
+    stb__sbn(cache->spans) = 0;
+  cache->version = p->version;
+  cache->w = display->w;
+  cache->h = display->h;
+  
+  *y_lo = *y_hi = 0;
+  if (p->num_points < 3 || !p->closed)
+    return;
+  
+  aabb_t bounds = polygon_bounds(p);
+  *y_lo = fill_clamp(bounds.min.y, 0, display->h);
+  *y_hi = fill_clamp(bounds.max.y, 0, display->h);
+  size_t num_edges;
+  polygon_edge_table(p, &num_edges);
+  polygon_is_monotone(p);
+}
+
+static void span_cache_scan(pixel_display_t* display, polygon_t* p, fill_rule_t rule,
+                            int y_lo, int y_hi, span_t** spans)
+{
+  span_cache_target_t target = {.spans = *spans, .w = display->w};
+  scan_fill_rows(p, y_lo, y_hi, rule, emit_cached_span, &target);
+  *spans = target.spans;
+}
+
+static size_t spans_lower_bound(const span_t* spans, size_t n, int y)
+{
+  size_t lo = 0;
+  while (n > 0)
+  {
+    size_t half = n / 2;
+    if (spans[lo + half].y < y)
+    {
+      lo += half + 1;
+      n -= half + 1;
+    }
+    else
+      n = half;
+  }
+  return lo;
+}
+
+const span_t* scan_fill_spans(pixel_display_t* display, polygon_t* p, fill_rule_t rule,
+                              int y_lo, int y_hi, size_t* num_spans)
+{
+  p = scan_fill_polygon(display, p);
+  span_cache_t* cache = p->span_caches + rule;
+  if (!span_cache_valid(cache, display, p))
+  {
+    int rows_lo, rows_hi;
+    span_cache_reset(cache, display, p, &rows_lo, &rows_hi);
+    if (rows_lo < rows_hi)
+      span_cache_scan(display, p, rule, rows_lo, rows_hi, &cache->spans);
+  }
+
+  size_t n = sb_count(cache->spans);
+  size_t first = spans_lower_bound(cache->spans, n, y_lo);
+  size_t last = spans_lower_bound(cache->spans, n, y_hi);
+  *num_spans = last > first ? last - first : 0;
+  return cache->spans + first;
+}
+
+typedef struct
+{
+  pixel_display_t* display;
+  polygon_t* polygon;
+  fill_rule_t rule;
+  int y_lo;
+  int y_hi;
+  span_t* spans;
+} span_band_t;
+
+static void scan_span_band(void* data, int index)
+{
+  span_band_t* band = (span_band_t*) data + index;
+  span_cache_scan(band->display, band->polygon, band->rule, band->y_lo, band->y_hi, &band->spans);
+}
+
+void scan_fill_update_spans(pixel_display_t* display, polygon_t* const* polys, const fill_rule_t* rules,
+                            size_t num_polys, job_pool_t* pool)
+{
+  span_band_t* bands = NULL;
+  for (size_t i = 0; i < num_polys; i++)
+  {
+    polygon_t* p = scan_fill_polygon(display, polys[i]);
+    span_cache_t* cache = p->span_caches + rules[i];
+    if (span_cache_valid(cache, display, p))
+      continue;
+
+    // Resetting tags the cache, so a fill listed twice is scanned once
+    int y_lo, y_hi;
+    span_cache_reset(cache, display, p, &y_lo, &y_hi);
+    for (int y = y_lo; y < y_hi; y += SPAN_BAND_ROWS)
+    {
+      span_band_t band = {.display = display, .polygon = p, .rule = rules[i], .y_lo = y,
+                          .y_hi = y + SPAN_BAND_ROWS < y_hi ? y + SPAN_BAND_ROWS : y_hi, .spans = NULL};
+      sb_push(bands, band);
+    }
+  }
+  
+  job_parallel_for(pool, sb_count(bands), scan_span_band, bands);
+
+  // The bands of a fill are in row order
+  for (int i = 0; i < sb_count(bands); i++)
+  {
+    span_band_t* band = bands + i;
+    span_cache_t* cache = band->polygon->span_caches + band->rule;
+    size_t n = sb_count(band->spans);
+    if (n)
+    {
+      span_t* dst = sb_add(cache->spans, n);
+      memcpy(dst, band->spans, sizeof(span_t) * n);
+      sb_free(band->spans);
+    }
+  }
+  sb_free(bands);
+}
+
+void scan_fill(pixel_display_t* display, pixel_t color, polygon_t* p, fill_rule_t rule)
+{
+  int y_lo, y_hi;
+  p = scan_fill_polygon(display, p);
+  if (!scan_fill_range(display, p, &y_lo, &y_hi))
+    return;
+
+  rect_t damage = scan_fill_rect(p);
+  damage.y0 = y_lo;
+  damage.y1 = y_hi;
+  pixel_display_damage(display, damage);
+
+  // Replays the cached spans, unchanged polygons are not scanned again
+  size_t num_spans;
+  const span_t* spans = scan_fill_spans(display, p, rule, y_lo, y_hi, &num_spans);
+  blend_t blend = blend_setup(color, 255, display->blend);
+  for (size_t i = 0; i < num_spans; i++)
+    clip_span(display, &blend, spans[i].y, spans[i].x0, spans[i].x1);
+}
+
+void fill_spans(pixel_display_t* display, pixel_t color, const span_t* spans, size_t num_spans)
+{
+  rect_t damage = {0, 0, 0, 0};
+  blend_t blend = blend_setup(color, 255, display->blend);
+  for (size_t i = 0; i < num_spans; i++)
+  {
+    const span_t* s = spans + i;
+    clip_span(display, &blend, s->y, s->x0, s->x1);
+    
+    rect_t r = {.x0 = s->x0, .y0 = s->y, .x1 = s->x1, .y1 = s->y + 1};
+    damage = rect_union(damage, r);
+  }
+  pixel_display_damage(display, damage);
+}
+
+// Triangle fill
+//
+// Half-space rasterization: a pixel is inside a triangle when its center
+// is on the inner side of all three edges, each edge a linear function of
+// the pixel position. Points are snapped to 1/TRI_SUBPIXEL of a pixel so
+// the edge functions are exact integers, and a pixel center on an edge
+// only goes to the triangle that has it as a top or left edge, so
+// triangles sharing an edge never both fill a pixel.
+//
+// Each triangle is walked in 8x8 blocks along the rows it covers. A block
+// outside an edge is skipped and edges it lies wholly inside are dropped,
+// so only the edges passing through it are tested per pixel, by the
+// block_mask kernel. The blocks of all the triangles are or'ed into a
+// coverage bitmap, a byte per 8 pixels of a row, which is then filled as
+// spans, so a row is not cut up where triangles meet.
+
+#define TRI_SUBPIXEL 16
+#define TRI_BLOCK 8
+
+// Keeps the edge function steps well within 32 bits
+#define TRI_MAX_COORD 16384
+
+typedef struct
+{
+  int64_t e;  // at the center of the first pixel of the bounds, biased so
+              // that inside is e >= 0
+  int32_t dx; // step per pixel right
+  int32_t dy; // step per pixel down
+} tri_edge_t;
+
+typedef struct
+{
+  int64_t x[3], y[3]; // in subpixels, wound with the inside on the left
+  tri_edge_t edges[3];
+  rect_t rect;        // pixels whose centers can be inside, clipped
+} tri_t;
+
+static int64_t min3(const int64_t* v)
+{
+  int64_t m = v[0] < v[1] ? v[0] : v[1];
+  return m < v[2] ? m : v[2];
+}
+
+static int64_t max3(const int64_t* v)
+{
+  int64_t m = v[0] > v[1] ? v[0] : v[1];
+  return m > v[2] ? m : v[2];
+}
+
+static bool tri_setup(tri_t* tri, const point_t* v0, const point_t* v1, const point_t* v2, rect_t clip)
+{
+  const point_t* v[3] = {v0, v1, v2};
+  int64_t* x = tri->x;
+  int64_t* y = tri->y;
+  for (int i = 0; i < 3; i++)
+  {
+    // Also turns away NaNs
+    if (!(fabsf(v[i]->x) <= TRI_MAX_COORD && fabsf(v[i]->y) <= TRI_MAX_COORD))
+      return false;
+    x[i] = lrintf(v[i]->x * TRI_SUBPIXEL);
+    y[i] = lrintf(v[i]->y * TRI_SUBPIXEL);
+  }
+
+  // Wind every triangle the same way, the inside on the positive side
+  int64_t area = ((x[1] - x[0]) * (y[2] - y[0])) - ((y[1] - y[0]) * (x[2] - x[0]));
+  if (area == 0)
+    return false;
+  if (area < 0)
+  {
+    int64_t t = x[1];
+    x[1] = x[2];
+    x[2] = t;
+    t = y[1];
+    y[1] = y[2];
+    y[2] = t;
+  }
+
+  int64_t half = TRI_SUBPIXEL / 2;
+  rect_t r;
+  r.x0 = -floor_div(half - min3(x), TRI_SUBPIXEL);
+  r.y0 = -floor_div(half - min3(y), TRI_SUBPIXEL);
+  r.x1 = floor_div(max3(x) - half, TRI_SUBPIXEL) + 1;
+  r.y1 = floor_div(max3(y) - half, TRI_SUBPIXEL) + 1;
+  r = rect_intersect(r, clip);
+  if (rect_is_empty(r))
+    return false;
+
+  int64_t px = ((int64_t) r.x0 * TRI_SUBPIXEL) + half;
+  int64_t py = ((int64_t) r.y0 * TRI_SUBPIXEL) + half;
+  for (int i = 0; i < 3; i++)
+  {
+    int j = (i + 1) % 3;
+    int64_t ex = x[j] - x[i];
+    int64_t ey = y[j] - y[i];
+    bool top_left = ey < 0 || (ey == 0 && ex > 0);
+    tri->edges[i].e = (ex * (py - y[i])) - (ey * (px - x[i])) - (top_left ? 0 : 1);
+    tri->edges[i].dx = (int32_t) (-ey * TRI_SUBPIXEL);
+    tri->edges[i].dy = (int32_t) (ex * TRI_SUBPIXEL);
+  }
+  tri->rect = r;
+  return true;
+}
+
+static int64_t ceil_div(int64_t n, int64_t d)
+{
+  return -floor_div(-n, d);
+}
+
+// Narrows [*k_lo, *k_hi] to the blocks k where e + (k * step) >= 0
+static void tri_block_range(int64_t e, int64_t step, int64_t* k_lo, int64_t* k_hi)
+{
+  if (step > 0)
+  {
+    int64_t k = ceil_div(-e, step);
+    if (k > *k_lo)
+      *k_lo = k;
+  }
+  else if (step < 0)
+  {
+    int64_t k = floor_div(e, -step);
+    if (k < *k_hi)
+      *k_hi = k;
+  }
+  else if (e < 0)
+    *k_hi = *k_lo - 1;
+}
+
+// Or's the blocks the triangle covers into the bitmap of rect, whose rows
+// start at column x_base
+static void tri_cover(const tri_t* tri, const kernels_t* kernels, uint8_t* coverage, rect_t rect,
+                      int x_base, int stride)
+{
+  // Blocks are aligned to the display so the tiles of a raster agree
+  rect_t r = tri->rect;
+  int bx0 = r.x0 - (r.x0 % TRI_BLOCK);
+  int by0 = r.y0 - (r.y0 % TRI_BLOCK);
+  int64_t num_blocks = (r.x1 - bx0 + TRI_BLOCK - 1) / TRI_BLOCK;
+  for (int by = by0; by < r.y1; by += TRI_BLOCK)
+  {
+    int row_lo = r.y0 > by ? r.y0 - by : 0;
+    int row_hi = r.y1 < by + TRI_BLOCK ? r.y1 - by : TRI_BLOCK;
+
+    // Each edge is linear along the band, so the blocks not outside it
+    // and the blocks wholly inside it are both a range. Only the blocks
+    // between the two have their pixels tested.
+    int64_t e[3], lo[3];
+    int64_t vis_lo = 0, vis_hi = num_blocks - 1;
+    int64_t full_lo = 0, full_hi = num_blocks - 1;
+    for (int i = 0; i < 3; i++)
+    {
+      const tri_edge_t* edge = tri->edges + i;
+      int64_t sx = (int64_t) (TRI_BLOCK - 1) * edge->dx;
+      int64_t sy = (int64_t) (TRI_BLOCK - 1) * edge->dy;
+      int64_t hi = (sx > 0 ? sx : 0) + (sy > 0 ? sy : 0);
+      e[i] = edge->e + ((int64_t) (bx0 - r.x0) * edge->dx) + ((int64_t) (by - r.y0) * edge->dy);
+      lo[i] = (sx < 0 ? sx : 0) + (sy < 0 ? sy : 0);
+      tri_block_range(e[i] + hi, (int64_t) TRI_BLOCK * edge->dx, &vis_lo, &vis_hi);
+      tri_block_range(e[i] + lo[i], (int64_t) TRI_BLOCK * edge->dx, &full_lo, &full_hi);
+    }
+
+    for (int64_t k = vis_lo; k <= vis_hi; k++)
+    {
+      int bx = bx0 + (k * TRI_BLOCK);
+      uint64_t mask = ~(uint64_t) 0;
+      if (k < full_lo || k > full_hi)
+      {
+        int32_t be[3], dx[3], dy[3];
+        int n = 0;
+        for (int i = 0; i < 3; i++)
+        {
+          int64_t eb = e[i] + (k * TRI_BLOCK * tri->edges[i].dx);
+          if (eb + lo[i] >= 0)
+            continue;
+          be[n] = (int32_t) eb;
+          dx[n] = tri->edges[i].dx;
+          dy[n] = tri->edges[i].dy;
+          n++;
+        }
+        mask = kernels->block_mask(be, dx, dy, n);
+      }
+
+      int col_lo = r.x0 > bx ? r.x0 - bx : 0;
+      int col_hi = r.x1 < bx + TRI_BLOCK ? r.x1 - bx : TRI_BLOCK;
+      unsigned int cols = (0xffu >> (TRI_BLOCK - col_hi)) & (0xffu << col_lo);
+      uint8_t* dst = coverage + ((size_t) (by - rect.y0) * stride) + ((bx - x_base) / TRI_BLOCK);
+      for (int row = row_lo; row < row_hi; row++)
+        dst[row * stride] |= (mask >> (row * TRI_BLOCK)) & cols;
+    }
+  }
+}
+
+// Fills the runs of set bits in a row of the bitmap
+static void tri_fill_row(pixel_display_t* display, const blend_t* blend, int y, int x_base,
+                         const uint8_t* bits, int n)
+{
+  int run = -1;
+  for (int i = 0; i < n; i++)
+  {
+    // Skip whole words that are empty or covered
+    if (i + 8 <= n && (i & 7) == 0)
+    {
+      uint64_t word;
+      memcpy(&word, bits + i, sizeof(word));
+      if ((run < 0 && word == 0) || (run >= 0 && word == ~(uint64_t) 0))
+      {
+        i += 7;
+        continue;
+      }
+    }
+
+    unsigned int b = bits[i];
+    int x = x_base + (i * TRI_BLOCK);
+    if (run >= 0 && b == 0xff)
+      continue;
+    if (run < 0 && b == 0)
+      continue;
+    for (int k = 0; k < TRI_BLOCK; k++)
+    {
+      bool set = (b >> k) & 1;
+      if (set && run < 0)
+        run = x + k;
+      else if (!set && run >= 0)
+      {
+        clip_span(display, blend, y, run, x + k);
+        run = -1;
+      }
+    }
+  }
+  if (run >= 0)
+    clip_span(display, blend, y, run, x_base + (n * TRI_BLOCK));
+}
+
+void fill_triangles(pixel_display_t* display, pixel_t color, const point_t* points,
+                    const int* indices, size_t num_triangles)
+{
+  tri_t* tris = NULL;
+  rect_t rect = {0, 0, 0, 0};
+  for (size_t i = 0; i < num_triangles; i++)
+  {
+    const int* t = indices + (i * 3);
+    tri_t tri;
+    if (!tri_setup(&tri, points + t[0], points + t[1], points + t[2], display->clip))
+      continue;
+    sb_push(tris, tri);
+    rect = rect_union(rect, tri.rect);
+  }
+  if (!tris)
+    return;
+
+  int x_base = rect.x0 - (rect.x0 % TRI_BLOCK);
+  int stride = (rect.x1 - x_base + TRI_BLOCK - 1) / TRI_BLOCK;
+  uint8_t* coverage = (uint8_t*) calloc((size_t) stride * (rect.y1 - rect.y0), 1);
+  
+  const kernels_t* kernels = draw_kernels();
+  for (int i = 0; i < sb_count(tris); i++)
+    tri_cover(tris + i, kernels, coverage, rect, x_base, stride);
+
+  blend_t blend = blend_setup(color, 255, display->blend);
+  for (int y = rect.y0; y < rect.y1; y++)
+    tri_fill_row(display, &blend, y, x_base, coverage + ((size_t) (y - rect.y0) * stride), stride);
+  pixel_display_damage(display, rect);
+
+  free(coverage);
+  sb_free(tris);
+}
+
+rect_t triangle_fill_rect(polygon_t* p)
+{
+  aabb_t bounds = polygon_bounds(p);
+  rect_t r;
+  r.x0 = fill_clamp(floor(bounds.min.x), INT_MIN / 2, INT_MAX / 2);
+  r.y0 = fill_clamp(floor(bounds.min.y), INT_MIN / 2, INT_MAX / 2);
+  r.x1 = fill_clamp(floor(bounds.max.x) + 1, INT_MIN / 2, INT_MAX / 2);
+  r.y1 = fill_clamp(floor(bounds.max.y) + 1, INT_MIN / 2, INT_MAX / 2);
+  return r;
+}
+
+void triangle_fill(pixel_display_t* display, pixel_t color, polygon_t* p, fill_rule_t rule)
+{
+  polygon_t* clipped = scan_fill_polygon(display, p);
+  if (clipped->num_points < 3 || !clipped->closed)
+    return;
+  if (!rect_overlap(triangle_fill_rect(clipped), display->clip))
+    return;
+  
+  size_t num_triangles;
+  const int* triangles = polygon_triangles(clipped, &num_triangles);
+  if (!triangles)
+  {
+    scan_fill(display, color, p, rule);
+    return;
+  }
+  fill_triangles(display, color, clipped->points, triangles, num_triangles);
+}
+
+// Anti-aliased fill
+//
+// Signed area accumulation, in the style of font-rs: every edge deposits
+// the area it covers into the cells of an accumulation row, and a running
+// sum along the row gives each pixel's winding coverage, which the fill
+// rule turns into alpha. Pixels are unit squares [x, x + 1) x [y, y + 1).
+//
+// Deposits are whole 16.16 fixed point differences of each cell's
+// cumulative coverage, so every row sums exactly and the result of a
+// pixel does not depend on the clip rect. Cells left of the clip collapse
+// into its first cell. Rows are worked in strips of AA_STRIP_ROWS.
+
+#define AA_ONE (1 << 16)
+#define AA_STRIP_ROWS 16
+
+// Each row keeps a bit per block of cells with deposits, so the runs of
+// empty cells between them are skipped without reading them
+#define AA_BLOCK_SHIFT 4
+#define AA_MARK_WORD_CELLS (64 << AA_BLOCK_SHIFT)
+
+static int32_t aa_fixed(float v)
+{
+  return (int32_t) floorf((v * AA_ONE) + 0.5f);
+}
+
+// Integral of clamp(u, 0, 1)
+static float aa_ramp_integral(float u)
+{
+  if (u <= 0)
+    return 0;
+  if (u <= 1)
+    return 0.5f * u * u;
+  return u - 0.5f;
+}
+
+static void aa_mark(uint64_t* marks, int lo, int hi)
+{
+  for (int b = lo >> AA_BLOCK_SHIFT; b <= hi >> AA_BLOCK_SHIFT; b++)
+    marks[b >> 6] |= (uint64_t) 1 << (b & 63);
+}
+
+// Deposits a piece of an edge crossing one row from x0 to x1, dy is the
+// signed height of the piece. The blocks written to are marked.
+static void aa_deposit(int32_t* acc, uint64_t* marks, int x_lo, int w, float x0, float x1, float dy)
+{
+  if (x0 > x1)
+  {
+    float t = x0;
+    x0 = x1;
+    x1 = t;
+  }
+  
+  int32_t full = aa_fixed(dy);
+  if (x0 >= x_lo + w)
+    return;
+  if (x1 < x_lo)
+  {
+    acc[0] += full;
+    aa_mark(marks, 0, 0);
+    return;
+  }
+
+  // Cumulative coverage of cell k is dy times the mean of clamp(k + 1 - x)
+  // along the piece, which is full from cell ceil(x1) on
+  int first = floorf(x0) < x_lo - 1 ? x_lo - 1 : (int) floorf(x0);
+  int last = (int) ceilf(x1);
+  bool thin = floorf(x0) == floorf(x1) || x1 - x0 < 1e-6f;
+  float mid = 0.5f * (x0 + x1);
+  int32_t prev = 0;
+
+  aa_mark(marks, first - x_lo < 0 ? 0 : first - x_lo, last - x_lo < w ? last - x_lo : w - 1);
+  
+  for (int k = first; k <= last; k++)
+  {
+    int32_t cur = full;
+    if (k < last)
+    {
+      float c;
+      if (thin)
+        c = k + 1 - mid;
+      else
+        c = (aa_ramp_integral(k + 1 - x0) - aa_ramp_integral(k + 1 - x1)) / (x1 - x0);
+      cur = aa_fixed(dy * (c < 0 ? 0 : (c > 1 ? 1 : c)));
+    }
+
+    int i = k - x_lo;
+    if (i >= w)
+      break;
+    acc[i < 0 ? 0 : i] += cur - prev;
+    prev = cur;
+  }
+}
+
+// Adds the pieces of edge u1 u2 in rows [y0, y1) to a strip of rows, whose
+// marks are mark_stride words apart
+static void aa_accumulate_edge(int32_t* acc, uint64_t* marks, int stride, int mark_stride,
+                               int x_lo, int w, int y0, int y1, point_t u1, point_t u2)
+{
+  if (u1.y == u2.y)
+    return;
+
+  float dir = 1;
+  if (u1.y > u2.y)
+  {
+    point_t t = u1;
+    u1 = u2;
+    u2 = t;
+    dir = -1;
+  }
+  
+  float dxdy = (u2.x - u1.x) / (u2.y - u1.y);
+  int row_lo = (int) floorf(u1.y) < y0 ? y0 : (int) floorf(u1.y);
+  int row_hi = (int) ceilf(u2.y) > y1 ? y1 : (int) ceilf(u2.y);
+  
+  for (int y = row_lo; y < row_hi; y++)
+  {
+    // From the row alone, so strips do not change the result
+    float ya = y > u1.y ? y : u1.y;
+    float yb = y + 1 < u2.y ? y + 1 : u2.y;
+    if (yb <= ya)
+      continue;
+    
+    float xa = u1.x + ((ya - u1.y) * dxdy);
+    float xb = u1.x + ((yb - u1.y) * dxdy);
+    aa_deposit(acc + ((y - y0) * stride), marks + ((y - y0) * mark_stride), x_lo, w,
+               xa, xb, dir * (yb - ya));
+  }
+}
+
+static int aa_alpha(int32_t sum, fill_rule_t rule)
+{
+  int32_t c = sum < 0 ? -sum : sum;
+  if (rule == FILL_EVEN_ODD)
+  {
+    c &= (2 * AA_ONE) - 1;
+    if (c > AA_ONE)
+      c = (2 * AA_ONE) - c;
+  }
+  else if (c > AA_ONE)
+    c = AA_ONE;
+  return ((c * 255) + (AA_ONE / 2)) >> 16;
+}
+
+typedef struct
+{
+  pixel_t color;
+  blend_mode_t mode;
+  blend_t full; // fully covered pixels
+} aa_paint_t;
+
+static void aa_emit(pixel_t* dst, size_t n, const aa_paint_t* paint, int alpha)
+{
+  if (!alpha)
+    return;
+  if (alpha == 255)
+  {
+    blend_span(dst, n, &paint->full);
+    return;
+  }
+  if (n == 1)
+  {
+    blend_pixel(dst, paint->color, alpha, paint->mode);
+    return;
+  }
+  
+  blend_t blend = blend_setup(paint->color, alpha, paint->mode);
+  blend_span(dst, n, &blend);
+}
+
+// First cell from i with a deposit, or w
+static int aa_skip_empty(const int32_t* acc, int i, int w)
+{
+#if defined(__AVX2__)
+  for (; i + 16 <= w; i += 16)
+  {
+    __m256i v = _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (acc + i)),
+                                _mm256_loadu_si256((const __m256i*) (acc + i + 8)));
+    if (!_mm256_testz_si256(v, v))
+      break;
+  }
+#elif defined(__SSE2__)
+  // Four vectors per branch, the loop is bound by the branch otherwise
+  for (; i + 16 <= w; i += 16)
+  {
+    __m128i v = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((const __m128i*) (acc + i)),
+                                          _mm_loadu_si128((const __m128i*) (acc + i + 4))),
+                             _mm_or_si128(_mm_loadu_si128((const __m128i*) (acc + i + 8)),
+                                          _mm_loadu_si128((const __m128i*) (acc + i + 12))));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) != 0xffff)
+      break;
+  }
+  for (; i + 4 <= w; i += 4)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*) (acc + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) != 0xffff)
+      break;
+  }
+#endif
+  while (i < w && !acc[i])
+    i++;
+  return i;
+}
+
+// Runs the sum along one row and writes the pixels, clearing the row and
+// its marks for the next strip. Runs of empty cells keep the coverage and
+// are written in one go, so the inside of a shape costs about as much as a
+// plain fill. Only the marked blocks are read.
+static void aa_resolve_row(pixel_t* dst, int32_t* acc, uint64_t* marks, int w,
+                           const aa_paint_t* paint, fill_rule_t rule)
+{
+  int32_t sum = 0;
+  int x = 0;
+  for (int word = 0; word * AA_MARK_WORD_CELLS < w; word++)
+  {
+    uint64_t bits = marks[word];
+    marks[word] = 0;
+    while (bits)
+    {
+      int lo = ((word << 6) + __builtin_ctzll(bits)) << AA_BLOCK_SHIFT;
+      int hi = lo + (1 << AA_BLOCK_SHIFT) < w ? lo + (1 << AA_BLOCK_SHIFT) : w;
+      bits &= bits - 1;
+      if (lo > x)
+      {
+        aa_emit(dst + x, lo - x, paint, aa_alpha(sum, rule));
+        x = lo;
+      }
+
+      while (x < hi)
+      {
+        if (!acc[x])
+        {
+          int run = aa_skip_empty(acc, x, hi);
+          aa_emit(dst + x, run - x, paint, aa_alpha(sum, rule));
+          x = run;
+          continue;
+        }
+
+        sum += acc[x];
+        acc[x] = 0;
+        aa_emit(dst + x, 1, paint, aa_alpha(sum, rule));
+        x++;
+      }
+    }
+  }
+  aa_emit(dst + x, w - x, paint, aa_alpha(sum, rule));
+}
+
+rect_t scan_fill_aa_rect(polygon_t* p)
+{
+  rect_t r = {0, 0, 0, 0};
+  if (!p->num_points)
+    return r;
+
+  aabb_t b = polygon_bounds(p);
+  r.x0 = floorf(b.min.x);
+  r.y0 = floorf(b.min.y);
+  r.x1 = floorf(b.max.x) + 1;
+  r.y1 = floorf(b.max.y) + 1;
+  return r;
+}
+
+// Rows [row_lo, row_hi) of r that edge i touches, false if there are none
+static bool aa_edge_rows(const polygon_t* p, int i, rect_t r, int* row_lo, int* row_hi)
+{
+  point_t u1 = p->points[i];
+  point_t u2 = p->points[(i + 1) % p->num_points];
+  if (u1.y == u2.y)
+    return false;
+
+  float y_lo = u1.y < u2.y ? u1.y : u2.y;
+  float y_hi = u1.y < u2.y ? u2.y : u1.y;
+  *row_lo = (int) floorf(y_lo) < r.y0 ? r.y0 : (int) floorf(y_lo);
+  *row_hi = (int) ceilf(y_hi) > r.y1 ? r.y1 : (int) ceilf(y_hi);
+  return *row_lo < *row_hi;
+}
+
+void scan_fill_aa(pixel_display_t* display, pixel_t color, polygon_t* p, fill_rule_t rule)
+{
+  p = scan_fill_polygon(display, p);
+  if (p->num_points < 3 || !p->closed)
+    return;
+
+  rect_t r = rect_intersect(scan_fill_aa_rect(p), display->clip);
+  if (rect_is_empty(r))
+    return;
+  pixel_display_damage(display, r);
+
+  int w = r.x1 - r.x0;
+  int stride = w;
+  int32_t* acc = (int32_t*) calloc(stride * AA_STRIP_ROWS, sizeof(int32_t));
+  int mark_stride = (w + AA_MARK_WORD_CELLS - 1) / AA_MARK_WORD_CELLS;
+  uint64_t* marks = (uint64_t*) calloc(mark_stride * AA_STRIP_ROWS, sizeof(uint64_t));
+  aa_paint_t paint = {.color = color, .mode = display->blend,
+                      .full = blend_setup(color, 255, display->blend)};
+
+  // Edge table: edges bucketed by the strip they start in, so each strip
+  // only walks the edges that cross it
+  int num_strips = (r.y1 - r.y0 + AA_STRIP_ROWS - 1) / AA_STRIP_ROWS;
+  int* strip_starts = (int*) calloc(num_strips + 1, sizeof(int));
+  int* strip_edges = (int*) malloc(sizeof(int) * p->num_points);
+  int* active = (int*) malloc(sizeof(int) * p->num_points);
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (int i = 0; i < p->num_points; i++)
+    {
+      int row_lo, row_hi;
+      if (!aa_edge_rows(p, i, r, &row_lo, &row_hi))
+        continue;
+      int strip = (row_lo - r.y0) / AA_STRIP_ROWS;
+      if (pass)
+        strip_edges[strip_starts[strip]++] = i;
+      else
+        strip_starts[strip + 1]++;
+    }
+
+    // Counts to starts. Filling moves each start to the end of its bucket,
+    // which is shifted back below.
+    if (!pass)
+    {
+      for (int i = 0; i < num_strips; i++)
+        strip_starts[i + 1] += strip_starts[i];
+    }
+  }
+  for (int i = num_strips; i > 0; i--)
+    strip_starts[i] = strip_starts[i - 1];
+  strip_starts[0] = 0;
+
+  int num_active = 0;
+  for (int strip = 0; strip < num_strips; strip++)
+  {
+    int y0 = r.y0 + (strip * AA_STRIP_ROWS);
+    int y1 = y0 + AA_STRIP_ROWS < r.y1 ? y0 + AA_STRIP_ROWS : r.y1;
+    for (int i = strip_starts[strip]; i < strip_starts[strip + 1]; i++)
+      active[num_active++] = strip_edges[i];
+
+    int kept = 0;
+    for (int i = 0; i < num_active; i++)
+    {
+      int edge = active[i];
+      point_t u1 = p->points[edge];
+      point_t u2 = p->points[(edge + 1) % p->num_points];
+      aa_accumulate_edge(acc, marks, stride, mark_stride, r.x0, w, y0, y1, u1, u2);
+
+      int row_lo, row_hi;
+      if (aa_edge_rows(p, edge, r, &row_lo, &row_hi) && row_hi > y1)
+        active[kept++] = edge;
+    }
+    num_active = kept;
+
+    for (int y = y0; y < y1; y++)
+      aa_resolve_row(display->buf + r.x0 + (y * display->w), acc + ((y - y0) * stride),
+                     marks + ((y - y0) * mark_stride), w, &paint, rule);
+  }
+  
+  free(marks);
+  free(active);
+  free(strip_edges);
+  free(strip_starts);
+  free(acc);
 }
@@ -1,16 +1,119 @@
 #pragma once
 
-#include "gl_pixel_display.h"
+#include "pixel_display.h"
 #include "geom.h"
+#include "job.h"
 
+// Everything but clear_display() and copy_display() combines color with
+// the display by its blend mode, see blend_mode_t
+
+// Midpoint circles, covering the pixels within radius + 1/2 of the center.
+// A radius of 0 is a single pixel.
+void fill_circle(pixel_display_t* display, pixel_t color, int x, int y, unsigned int radius);
+void draw_circle(pixel_display_t* display, pixel_t color, int x, int y, unsigned int radius);
+
+// A filled circle marker
 void draw_point(pixel_display_t* display, pixel_t color, int x, int y, unsigned int radius);
 
+// Markers at each point, truncated to pixels, sharing the circle setup and
+// damage between them
+void draw_points(pixel_display_t* display, pixel_t color, const point_t* points, size_t num_points,
+                 unsigned int radius);
+
 void clear_display(pixel_display_t* display, pixel_t color);
 
+// Copies the pixels of rect from src to the same place in the display,
+// clipped to both
+void copy_display(pixel_display_t* display, const pixel_display_t* src, rect_t rect);
+
+// Fills the pixels [x0, x1) of row y, clipped to the display
+void fill_span(pixel_display_t* display, pixel_t color, int y, int x0, int x1);
+
+// Draws from (x1, y1) up to but not including (x2, y2), clipped to the
+// clip rect before stepping. Anti-aliased with QUALITY_ANTIALIASED, see
+// draw_line_aa
 void draw_line(pixel_display_t* display, pixel_t color,
                int x1, int y1, int x2, int y2);
 
+// Wu anti-aliased line, each pixel blended by its coverage. Touches at
+// most one pixel beyond the end points.
+void draw_line_aa(pixel_display_t* display, pixel_t color,
+                  float x1, float y1, float x2, float y2);
+
 void draw_polygon_bounds(pixel_display_t* display, pixel_t color, polygon_t* poly);
 void draw_polygon_points(pixel_display_t* display, pixel_t color, polygon_t* p, unsigned int radius);
 
-void scan_fill(pixel_display_t* display, pixel_t color, polygon_t* p);
+typedef enum
+{
+  FILL_EVEN_ODD,
+  FILL_NON_ZERO
+} fill_rule_t;
+
+// Fills the polygon by the rule, self intersections included
+void scan_fill(pixel_display_t* display, pixel_t color, polygon_t* p, fill_rule_t rule);
+
+// Span generation behind scan_fill, for renderers that split a fill up
+
+typedef void (*span_func_t)(void* data, int y, int x0, int x1);
+
+// The polygon scan_fill and scan_fill_aa actually fill, clipped to a guard
+// band around the display when it reaches far past it. Cached on the
+// polygon, see polygon_clipped.
+polygon_t* scan_fill_polygon(pixel_display_t* display, polygon_t* p);
+
+// Rows of the display scan_fill would scan, false if there is nothing to
+// fill. Updates the polygon's caches, later calls only read them.
+bool scan_fill_range(pixel_display_t* display, polygon_t* p, int* y_lo, int* y_hi);
+
+// Pixels scan_fill may touch, ignoring the display
+rect_t scan_fill_rect(polygon_t* p);
+
+// The spans scan_fill fills in rows [y_lo, y_hi) of the display, clipped
+// to its width. They are cached on the polygon scan_fill_polygon() gives,
+// for every row of the display, and only scanned again once the polygon
+// or display size changes. scan_fill replays them, so redrawing a polygon
+// that has not moved costs about a span fill per span.
+const span_t* scan_fill_spans(pixel_display_t* display, polygon_t* p, fill_rule_t rule,
+                              int y_lo, int y_hi, size_t* num_spans);
+
+// Brings the span caches of a set of fills up to date, scanning bands of
+// rows in parallel on the pool. Later scan_fill_spans() calls for the same
+// fills only read the caches.
+void scan_fill_update_spans(pixel_display_t* display, polygon_t* const* polys, const fill_rule_t* rules,
+                            size_t num_polys, job_pool_t* pool);
+
+// Calls emit with the spans scan_fill fills in rows [y_lo, y_hi), in
+// order. Spans are not clipped. Any row range gives the same spans as the
+// same rows of a full fill.
+void scan_fill_rows(polygon_t* p, int y_lo, int y_hi, fill_rule_t rule,
+                    span_func_t emit, void* data);
+
+// Half-space fill of triangles, each three indices into points, testing
+// the pixels of 8x8 blocks together in SIMD. A pixel is inside a triangle
+// when its center is, or lies on a top or left edge, so triangles that
+// share an edge leave no gap along it. Pixels inside several triangles
+// are filled once. Points are snapped to 1/16 of a pixel, and triangles
+// reaching more than 16384 pixels from the origin are skipped.
+void fill_triangles(pixel_display_t* display, pixel_t color, const point_t* points,
+                    const int* indices, size_t num_triangles);
+
+// Fills the polygon by fill_triangles with its cached triangulation, see
+// polygon_triangles, clipped to the guard band like scan_fill. Polygons
+// without one are scan filled by the rule. Pixel centers decide coverage,
+// so edges can differ from scan_fill by a pixel.
+void triangle_fill(pixel_display_t* display, pixel_t color, polygon_t* p, fill_rule_t rule);
+
+// Pixels triangle_fill may touch when the polygon has triangles, ignoring
+// the display
+rect_t triangle_fill_rect(polygon_t* p);
+
+// Anti-aliased fill from the exact area each pixel covers, each pixel
+// blended by its coverage. Self intersecting polygons are filled by the
+// rule.
+void scan_fill_aa(pixel_display_t* display, pixel_t color, polygon_t* p, fill_rule_t rule);
+
+// Pixels scan_fill_aa may touch, ignoring the display
+rect_t scan_fill_aa_rect(polygon_t* p);
+
+// Fills a run of spans clipped to the display, damaging their bounds once
+void fill_spans(pixel_display_t* display, pixel_t color, const span_t* spans, size_t num_spans);
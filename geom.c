@@ -1,8 +1,14 @@
 #include <stdbool.h>
+#include <string.h>
+#include <math.h>
 #include <stb/stretchy_buffer.h>
 
 #include "geom.h"
-#include "draw.h"
+#include "bvh.h"
+#include "job.h"
+
+// Below this many edges a linear scan beats walking the BVH
+#define BVH_MIN_EDGES 32
 
 void create_polygon(polygon_t* poly)
 {
@@ -11,50 +17,632 @@ void create_polygon(polygon_t* poly)
   poly->num_edges = 0;
   poly->complex = false;
   poly->closed = false;
+
+  poly->version = 1;
+  poly->complex_version = 1;
+  poly->shape_version = 0;
+  poly->convex = false;
+  poly->monotone = false;
+  poly->bounds_version = 0;
+  poly->edges_version = 0;
+  poly->edges = NULL;
+  poly->num_table_edges = 0;
+  poly->bvh_version = 0;
+  poly->bvh = NULL;
+  poly->triangles_version = 0;
+  poly->triangles = NULL;
+  poly->num_triangles = 0;
+  poly->clip_version = 0;
+  poly->clipped = NULL;
+  for (int i = 0; i < 2; i++)
+  {
+    poly->span_caches[i].version = 0;
+    poly->span_caches[i].spans = NULL;
+  }
+}
+
+void create_polygon_from_points(polygon_t* poly, const point_t* points, size_t num_points)
+{
+  create_polygon(poly);
+  if (!num_points)
+    return;
+
+  point_t* dst = sb_add(poly->points, num_points);
+  memcpy(dst, points, sizeof(point_t) * num_points);
+  poly->num_points = num_points;
+  poly->num_edges = num_points;
+  poly->closed = true;
+  polygon_touch(poly);
+}
+
+// Does segment l1 l2 cross any edge of p
+static bool line_edges_intersect(point_t l1, point_t l2, polygon_t* p)
+{
+  for (int j = 0; j < p->num_edges; j++)
+  {
+    // edge 1
+    point_t* u1 = p->points + j;
+    point_t* u2 = p->points + ((j +  1) % p->num_points);
+    
+    if (lines_intersect(*u1, *u2, l1, l2))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Only the new edge can introduce a crossing, so an up to date flag can be
+// extended in O(n) instead of sweeping the whole polygon again
+static void polygon_add_edges(polygon_t* poly, size_t first_edge)
+{
+  bool was_valid = poly->complex_version == poly->version;
+  poly->version++;
+  if (!was_valid)
+    return;
+
+  for (size_t i = first_edge; i < poly->num_edges && !poly->complex; i++)
+  {
+    point_t* u1 = poly->points + i;
+    point_t* u2 = poly->points + ((i + 1) % poly->num_points);
+    poly->complex = line_edges_intersect(*u1, *u2, poly);
+  }
+  poly->complex_version = poly->version;
 }
 
 void polygon_add_point(polygon_t* poly, point_t point)
 {
+  size_t first_edge = poly->num_edges;
   sb_push(poly->points, point);
   poly->num_edges = poly->num_points;
   poly->num_points++;
-  poly->complex = poly_self_intersect(poly);
+  polygon_add_edges(poly, first_edge);
 }
 
 void polygon_close(polygon_t* poly, point_t point)
 {
+  size_t first_edge = poly->num_edges;
   sb_push(poly->points, point);
   poly->num_edges += 2;
   poly->num_points++;
   poly->closed = true;
-  poly->complex = poly_self_intersect(poly);
+  polygon_add_edges(poly, first_edge);
 }
 
 void delete_polygon(polygon_t* poly)
 {
   if (poly->points)
     sb_free(poly->points);
+  poly->points = NULL;
   poly->num_points = 0;
+  poly->num_edges = 0;
+  
+  free(poly->edges);
+  poly->edges = NULL;
+  poly->num_table_edges = 0;
+
+  if (poly->bvh)
+  {
+    delete_bvh(poly->bvh);
+    free(poly->bvh);
+  }
+  poly->bvh = NULL;
+
+  free(poly->triangles);
+  poly->triangles = NULL;
+  poly->num_triangles = 0;
+
+  if (poly->clipped)
+  {
+    delete_polygon(poly->clipped);
+    free(poly->clipped);
+  }
+  poly->clipped = NULL;
+
+  for (int i = 0; i < 2; i++)
+  {
+    if (poly->span_caches[i].spans)
+      sb_free(poly->span_caches[i].spans);
+    poly->span_caches[i].spans = NULL;
+  }
+  polygon_touch(poly);
+}
+
+void polygon_touch(polygon_t* poly)
+{
+  poly->version++;
+}
+
+bool polygon_is_complex(polygon_t* poly)
+{
+  if (poly->complex_version != poly->version)
+  {
+    poly->complex = poly_self_intersect(poly);
+    poly->complex_version = poly->version;
+  }
+  return poly->complex;
+}
+
+// Turn from edge direction a to b, or 2 if b doubles back
+static int edge_turn(point_t a, point_t b)
+{
+  float cross = a.x * b.y - a.y * b.x;
+  if (cross == 0)
+    return a.x * b.x + a.y * b.y < 0 ? 2 : 0;
+  return cross > 0 ? 1 : -1;
+}
+
+static point_t polygon_edge(polygon_t* poly, size_t i)
+{
+  point_t a = poly->points[i];
+  point_t b = poly->points[(i + 1) % poly->num_points];
+  point_t edge = {b.x - a.x, b.y - a.y};
+  return edge;
+}
+
+static void polygon_update_shape(polygon_t* poly)
+{
+  // Start from the last edge that goes anywhere, and the last that is not
+  // flat, so the wrap around onto the first edge is counted too
+  size_t n = poly->num_points;
+  point_t prev = {0, 0};
+  int dir = 0;
+  for (size_t i = n; i-- > 0 && (!dir || (prev.x == 0 && prev.y == 0));)
+  {
+    point_t edge = polygon_edge(poly, i);
+    if (prev.x == 0 && prev.y == 0)
+      prev = edge;
+    if (!dir)
+      dir = (edge.y > 0) - (edge.y < 0);
+  }
+
+  int turns = 0;
+  int turn = 0;
+  bool convex = true;
+  for (size_t i = 0; i < n; i++)
+  {
+    point_t edge = polygon_edge(poly, i);
+    if (edge.x == 0 && edge.y == 0)
+      continue;
+
+    // Flat edges do not change the direction in y
+    int d = (edge.y > 0) - (edge.y < 0);
+    if (d && d != dir)
+      turns++;
+    if (d)
+      dir = d;
+
+    // Collinear edges are fine as long as they do not double back
+    int t = edge_turn(prev, edge);
+    if (t == 2 || (t && turn && t != turn))
+      convex = false;
+    if (t)
+      turn = t;
+    prev = edge;
+  }
+
+  poly->monotone = turns <= 2;
+  poly->convex = poly->monotone && convex;
+  poly->shape_version = poly->version;
+}
+
+bool polygon_is_convex(polygon_t* poly)
+{
+  if (poly->shape_version != poly->version)
+    polygon_update_shape(poly);
+  return poly->convex;
+}
+
+bool polygon_is_monotone(polygon_t* poly)
+{
+  if (poly->shape_version != poly->version)
+    polygon_update_shape(poly);
+  return poly->monotone;
+}
+
+aabb_t polygon_bounds(polygon_t* poly)
+{
+  if (poly->bounds_version == poly->version)
+    return poly->bounds;
+
+  aabb_t b;
+  b.min.x = b.min.y = 0;
+  b.max.x = b.max.y = 0;
+  for (size_t i = 0; i < poly->num_points; i++)
+  {
+    point_t pt = poly->points[i];
+    if (i == 0 || pt.x < b.min.x)
+      b.min.x = pt.x;
+    if (i == 0 || pt.y < b.min.y)
+      b.min.y = pt.y;
+    if (i == 0 || pt.x > b.max.x)
+      b.max.x = pt.x;
+    if (i == 0 || pt.y > b.max.y)
+      b.max.y = pt.y;
+  }
+  
+  poly->bounds = b;
+  poly->bounds_version = poly->version;
+  return b;
 }
 
-int line_coefficient(point_t p, point_t l1, point_t l2)
+static int edge_comparator(const void* p_e1, const void* p_e2)
 {
-  return ((p.x - l1.x) * (l2.y - l1.y)) - ((p.y - l1.y) * (l2.x - l1.x));
+  const edge_t* e1 = (const edge_t*) p_e1;
+  const edge_t* e2 = (const edge_t*) p_e2;
+  
+  if (e1->y_start != e2->y_start)
+    return e1->y_start < e2->y_start ? -1 : 1;
+  return e1->index - e2->index;
+}
+
+const edge_t* polygon_edge_table(polygon_t* poly, size_t* num_edges)
+{
+  if (poly->edges_version == poly->version)
+  {
+    *num_edges = poly->num_table_edges;
+    return poly->edges;
+  }
+
+  free(poly->edges);
+  poly->edges = (edge_t*) malloc(sizeof(edge_t) * (poly->num_edges ? poly->num_edges : 1));
+  
+  size_t n = 0;
+  for (int i = 0; i < poly->num_edges; i++)
+  {
+    point_t* u1 = poly->points + i;
+    point_t* u2 = poly->points + ((i + 1) % poly->num_points);
+    edge_t* edge = poly->edges + n;
+
+    edge->index = i;
+    if (u1->y == u2->y)
+    {
+      // Horizontal edges only contribute their starting vertex
+      if (u1->y != floor(u1->y))
+        continue;
+      edge->flat = true;
+      edge->dxdy = 0;
+      edge->y_start = u1->y;
+      edge->y_end = u1->y + 1;
+    }
+    else
+    {
+      // Scanlines strictly between the end points, plus the starting vertex
+      double lo = u1->y < u2->y ? u1->y : u2->y;
+      double hi = u1->y < u2->y ? u2->y : u1->y;
+      bool starts_on_row = u1->y == floor(u1->y);
+      
+      edge->flat = false;
+      edge->dxdy = (double) (u2->x - u1->x) / (double) (u2->y - u1->y);
+      edge->y_start = (starts_on_row && u1->y == lo) ? lo : floor(lo) + 1;
+      edge->y_end = (starts_on_row && u1->y == hi) ? hi + 1 : ceil(hi);
+      if (edge->y_start >= edge->y_end)
+        continue;
+    }
+    n++;
+  }
+
+  qsort(poly->edges, n, sizeof(edge_t), edge_comparator);
+  
+  poly->num_table_edges = n;
+  poly->edges_version = poly->version;
+  *num_edges = n;
+  return poly->edges;
+}
+
+// Polygon clipping
+//
+// Sutherland-Hodgman clipping, one side of the box at a time. Each side
+// is given as the axis it bounds, its position and which way is inside.
+
+static bool clip_inside(point_t p, int axis, float pos, bool below)
+{
+  float v = axis ? p.y : p.x;
+  return below ? v <= pos : v >= pos;
+}
+
+// Worked in double, the far end of an edge may be a long way off
+static point_t clip_crossing(point_t a, point_t b, int axis, float pos)
+{
+  point_t p;
+  if (axis)
+  {
+    double t = ((double) pos - a.y) / ((double) b.y - a.y);
+    p.x = a.x + (((double) b.x - a.x) * t);
+    p.y = pos;
+  }
+  else
+  {
+    double t = ((double) pos - a.x) / ((double) b.x - a.x);
+    p.x = pos;
+    p.y = a.y + (((double) b.y - a.y) * t);
+  }
+  return p;
+}
+
+static point_t* clip_side(const point_t* in, point_t* out, int axis, float pos, bool below)
+{
+  if (out)
+    stb__sbn(out) = 0;
+  for (int i = 0; i < sb_count(in); i++)
+  {
+    point_t a = in[i];
+    point_t b = in[(i + 1) % sb_count(in)];
+    bool a_in = clip_inside(a, axis, pos, below);
+    bool b_in = clip_inside(b, axis, pos, below);
+    
+    if (a_in)
+      sb_push(out, a);
+    if (a_in != b_in)
+      sb_push(out, clip_crossing(a, b, axis, pos));
+  }
+  return out;
+}
+
+polygon_t* polygon_clipped(polygon_t* poly, aabb_t box)
+{
+  aabb_t bounds = polygon_bounds(poly);
+  if (!poly->closed || (bounds.min.x >= box.min.x && bounds.min.y >= box.min.y
+                        && bounds.max.x <= box.max.x && bounds.max.y <= box.max.y))
+    return poly;
+  if (poly->clipped && poly->clip_version == poly->version
+      && !memcmp(&poly->clip_box, &box, sizeof(box)))
+    return poly->clipped;
+  
+  if (!poly->clipped)
+  {
+    poly->clipped = (polygon_t*) malloc(sizeof(polygon_t));
+    create_polygon(poly->clipped);
+  }
+
+  // Ping-pong between the clipped polygon's points and a scratch buffer
+  point_t* a = poly->clipped->points;
+  point_t* b = NULL;
+  if (a)
+    stb__sbn(a) = 0;
+  point_t* dst = sb_add(a, poly->num_points);
+  memcpy(dst, poly->points, sizeof(point_t) * poly->num_points);
+  
+  b = clip_side(a, b, 0, box.min.x, false);
+  a = clip_side(b, a, 0, box.max.x, true);
+  b = clip_side(a, b, 1, box.min.y, false);
+  a = clip_side(b, a, 1, box.max.y, true);
+  sb_free(b);
+
+  polygon_t* clipped = poly->clipped;
+  clipped->points = a;
+  clipped->num_points = sb_count(a);
+  clipped->num_edges = clipped->num_points;
+  clipped->closed = true;
+  polygon_touch(clipped);
+  
+  poly->clip_box = box;
+  poly->clip_version = poly->version;
+  return clipped;
+}
+
+// Edge BVH
+
+typedef struct
+{
+  polygon_t* poly;
+  point_t a;
+  point_t b;
+  bool inside;
+} edge_query_t;
+
+static aabb_t edge_box(polygon_t* poly, int edge)
+{
+  point_t u1 = poly->points[edge];
+  point_t u2 = poly->points[(edge + 1) % poly->num_points];
+  aabb_t box;
+  box.min.x = u1.x < u2.x ? u1.x : u2.x;
+  box.min.y = u1.y < u2.y ? u1.y : u2.y;
+  box.max.x = u1.x < u2.x ? u2.x : u1.x;
+  box.max.y = u1.y < u2.y ? u2.y : u1.y;
+  return box;
+}
+
+const bvh_t* polygon_edge_bvh(polygon_t* poly)
+{
+  if (poly->bvh && poly->bvh_version == poly->version)
+    return poly->bvh;
+
+  if (!poly->bvh)
+  {
+    poly->bvh = (bvh_t*) malloc(sizeof(bvh_t));
+    create_bvh(poly->bvh);
+  }
+  
+  aabb_t* boxes = (aabb_t*) malloc(sizeof(aabb_t) * (poly->num_edges ? poly->num_edges : 1));
+  for (int i = 0; i < poly->num_edges; i++)
+    boxes[i] = edge_box(poly, i);
+
+  // Same edges in new places, the tree shape can stay
+  if (poly->bvh->num_items == poly->num_edges)
+    bvh_refit(poly->bvh, boxes);
+  else
+    bvh_build(poly->bvh, boxes, poly->num_edges);
+  free(boxes);
+  
+  poly->bvh_version = poly->version;
+  return poly->bvh;
+}
+
+static bool segment_crosses_edge(void* data, int edge)
+{
+  edge_query_t* query = (edge_query_t*) data;
+  polygon_t* p = query->poly;
+  point_t* u1 = p->points + edge;
+  point_t* u2 = p->points + ((edge + 1) % p->num_points);
+  return lines_intersect(*u1, *u2, query->a, query->b);
+}
+
+// Flips the inside flag for each edge crossed by a ray going right from
+// the query point
+static bool ray_crosses_edge(void* data, int edge)
+{
+  edge_query_t* query = (edge_query_t*) data;
+  polygon_t* p = query->poly;
+  point_t u1 = p->points[edge];
+  point_t u2 = p->points[(edge + 1) % p->num_points];
+  point_t pt = query->a;
+  
+  if ((u1.y > pt.y) != (u2.y > pt.y))
+  {
+    double x = u1.x + (double) (pt.y - u1.y) * (u2.x - u1.x) / (u2.y - u1.y);
+    if (pt.x < x)
+      query->inside = !query->inside;
+  }
+  return false;
+}
+
+bool polygon_contains_point(polygon_t* poly, point_t point)
+{
+  if (!poly->closed)
+    return false;
+  
+  edge_query_t query = {.poly = poly, .a = point, .inside = false};
+  if (poly->num_edges < BVH_MIN_EDGES)
+  {
+    for (int i = 0; i < poly->num_edges; i++)
+      ray_crosses_edge(&query, i);
+    return query.inside;
+  }
+  
+  aabb_t ray;
+  ray.min = point;
+  ray.max.x = INFINITY;
+  ray.max.y = point.y;
+  bvh_query(polygon_edge_bvh(poly), ray, ray_crosses_edge, &query);
+  return query.inside;
+}
+
+static float edge_distance2(void* data, int edge, point_t pt)
+{
+  polygon_t* p = (polygon_t*) data;
+  point_t u1 = p->points[edge];
+  point_t u2 = p->points[(edge + 1) % p->num_points];
+
+  // Project onto the edge and clamp to its end points
+  float ex = u2.x - u1.x;
+  float ey = u2.y - u1.y;
+  float len2 = ex * ex + ey * ey;
+  float t = len2 > 0 ? ((pt.x - u1.x) * ex + (pt.y - u1.y) * ey) / len2 : 0;
+  if (t < 0)
+    t = 0;
+  else if (t > 1)
+    t = 1;
+  
+  float dx = u1.x + t * ex - pt.x;
+  float dy = u1.y + t * ey - pt.y;
+  return dx * dx + dy * dy;
+}
+
+int polygon_nearest_edge(polygon_t* poly, point_t point, float max_d, float* dist)
+{
+  float d2;
+  int edge = bvh_nearest(polygon_edge_bvh(poly), point, max_d * max_d,
+                         edge_distance2, poly, &d2);
+  if (edge >= 0 && dist)
+    *dist = sqrtf(d2);
+  return edge;
+}
+
+// Polygon set BVH
+
+typedef struct
+{
+  polygon_t* polys;
+  point_t a;
+  point_t b;
+  int found;
+} polygon_set_query_t;
+
+void polygon_set_update_bvh(bvh_t* bvh, polygon_t* polys, size_t num_polys)
+{
+  aabb_t* boxes = (aabb_t*) malloc(sizeof(aabb_t) * (num_polys ? num_polys : 1));
+  for (size_t i = 0; i < num_polys; i++)
+    boxes[i] = polygon_bounds(polys + i);
+
+  if (bvh->num_items == num_polys)
+    bvh_refit(bvh, boxes);
+  else
+    bvh_build(bvh, boxes, num_polys);
+  free(boxes);
+}
+
+// Each job only touches its own polygon's caches
+static void update_polygon_caches(void* data, int index)
+{
+  polygon_t* poly = (polygon_t*) data + index;
+  size_t num_edges;
+  
+  polygon_bounds(poly);
+  polygon_is_monotone(poly);
+  polygon_edge_table(poly, &num_edges);
+  if (poly->num_edges >= BVH_MIN_EDGES)
+    polygon_edge_bvh(poly);
+}
+
+void polygon_set_update_caches(polygon_t* polys, size_t num_polys, job_pool_t* pool)
+{
+  job_parallel_for(pool, num_polys, update_polygon_caches, polys);
+}
+
+static bool segment_crosses_polygon(void* data, int poly)
+{
+  polygon_set_query_t* query = (polygon_set_query_t*) data;
+  if ((query->found < 0 || poly < query->found)
+      && line_poly_intersect(query->a, query->b, query->polys + poly))
+    query->found = poly;
+  return false;
+}
+
+int polygon_set_segment_intersect(const bvh_t* bvh, polygon_t* polys,
+                                  point_t l1, point_t l2)
+{
+  polygon_set_query_t query = {.polys = polys, .a = l1, .b = l2, .found = -1};
+  bvh_query_segment(bvh, l1, l2, segment_crosses_polygon, &query);
+  return query.found;
+}
+
+static bool polygon_contains(void* data, int poly)
+{
+  polygon_set_query_t* query = (polygon_set_query_t*) data;
+  if (poly > query->found
+      && polygon_contains_point(query->polys + poly, query->a))
+    query->found = poly;
+  return false;
+}
+
+int polygon_set_find_containing(const bvh_t* bvh, polygon_t* polys, point_t point)
+{
+  polygon_set_query_t query = {.polys = polys, .a = point, .found = -1};
+  aabb_t box = {.min = point, .max = point};
+  bvh_query(bvh, box, polygon_contains, &query);
+  return query.found;
+}
+
+double line_coefficient(point_t p, point_t l1, point_t l2)
+{
+  return ((double) (p.x - l1.x) * (double) (l2.y - l1.y))
+    - ((double) (p.y - l1.y) * (double) (l2.x - l1.x));
 }
 
 bool lines_intersect(point_t u1, point_t u2,
                      point_t p1, point_t p2)
 {
-  int u1_c = line_coefficient(u1, p1, p2);
-  int u2_c = line_coefficient(u2, p1, p2);
+  double u1_c = line_coefficient(u1, p1, p2);
+  double u2_c = line_coefficient(u2, p1, p2);
 
   bool u_result = (u1_c > 0 && u2_c < 0) || (u2_c > 0 && u1_c < 0);
   
   if (!u_result)
     return false;
   
-  int p1_c = line_coefficient(p1, u1, u2);
-  int p2_c = line_coefficient(p2, u1, u2);
+  double p1_c = line_coefficient(p1, u1, u2);
+  double p2_c = line_coefficient(p2, u1, u2);
 
   bool p_result = (p1_c > 0 && p2_c < 0) || (p2_c > 0 && p1_c < 0);
 
@@ -67,32 +655,810 @@ bool lines_intersect(point_t u1, point_t u2,
 bool line_poly_intersect(point_t l1, point_t l2,
                          polygon_t* p)
 {
-  for (int j = 0; j < p->num_edges; j++)
+  if (p->num_edges < BVH_MIN_EDGES)
+    return line_edges_intersect(l1, l2, p);
+
+  edge_query_t query = {.poly = p, .a = l1, .b = l2};
+  return bvh_query_segment(polygon_edge_bvh(p), l1, l2, segment_crosses_edge, &query);
+}
+
+// Self intersection sweep (Shamos-Hoey)
+//
+// A vertical line sweeps the edges from left to right. Active edges are
+// kept in a treap ordered by height along the sweep line. Two edges can
+// only be the first crossing pair once they are neighbours in that order,
+// so each edge is only tested against its neighbours when it is inserted,
+// and its neighbours against each other when it is removed.
+
+typedef struct
+{
+  float x;
+  float y;
+  int edge;
+  bool remove;
+} sweep_event_t;
+
+typedef struct
+{
+  int left;
+  int right;
+  int parent;
+  unsigned int priority;
+  point_t l; // left end point
+  point_t r; // right end point
+} sweep_node_t;
+
+typedef struct
+{
+  sweep_node_t* nodes;
+  int root;
+} sweep_t;
+
+static bool point_less(point_t a, point_t b)
+{
+  return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+static int sweep_event_comparator(const void* p_e1, const void* p_e2)
+{
+  const sweep_event_t* e1 = (const sweep_event_t*) p_e1;
+  const sweep_event_t* e2 = (const sweep_event_t*) p_e2;
+
+  if (e1->x != e2->x)
+    return e1->x < e2->x ? -1 : 1;
+  if (e1->y != e2->y)
+    return e1->y < e2->y ? -1 : 1;
+  // Remove before inserting at the same point
+  if (e1->remove != e2->remove)
+    return e1->remove ? -1 : 1;
+  return e1->edge - e2->edge;
+}
+
+// Is edge a below edge b, where a starts on the sweep line
+static bool sweep_below(sweep_t* s, int a, int b)
+{
+  sweep_node_t* na = s->nodes + a;
+  sweep_node_t* nb = s->nodes + b;
+  
+  double o = line_coefficient(na->l, nb->l, nb->r);
+  if (o == 0)
+    o = line_coefficient(na->r, nb->l, nb->r);
+  if (o == 0)
+    return a < b;
+  return o > 0;
+}
+
+static void sweep_rotate_up(sweep_t* s, int x)
+{
+  sweep_node_t* n = s->nodes;
+  int p = n[x].parent;
+  int g = n[p].parent;
+  
+  if (n[p].left == x)
   {
-    // edge 1
-    point_t* u1 = p->points + j;
-    point_t* u2 = p->points + ((j +  1) % p->num_points);
+    n[p].left = n[x].right;
+    if (n[x].right >= 0)
+      n[n[x].right].parent = p;
+    n[x].right = p;
+  }
+  else
+  {
+    n[p].right = n[x].left;
+    if (n[x].left >= 0)
+      n[n[x].left].parent = p;
+    n[x].left = p;
+  }
+  n[p].parent = x;
+  n[x].parent = g;
+  
+  if (g < 0)
+    s->root = x;
+  else if (n[g].left == p)
+    n[g].left = x;
+  else
+    n[g].right = x;
+}
+
+static void sweep_insert(sweep_t* s, int x)
+{
+  sweep_node_t* n = s->nodes;
+  n[x].left = -1;
+  n[x].right = -1;
+  n[x].parent = -1;
+
+  if (s->root < 0)
+  {
+    s->root = x;
+    return;
+  }
+
+  int cur = s->root;
+  for (;;)
+  {
+    int* next = sweep_below(s, x, cur) ? &n[cur].left : &n[cur].right;
+    if (*next < 0)
+    {
+      *next = x;
+      n[x].parent = cur;
+      break;
+    }
+    cur = *next;
+  }
+
+  while (n[x].parent >= 0 && n[n[x].parent].priority < n[x].priority)
+    sweep_rotate_up(s, x);
+}
+
+static void sweep_remove(sweep_t* s, int x)
+{
+  sweep_node_t* n = s->nodes;
+
+  // Rotate down to a leaf, then unlink
+  while (n[x].left >= 0 || n[x].right >= 0)
+  {
+    int c;
+    if (n[x].left < 0)
+      c = n[x].right;
+    else if (n[x].right < 0)
+      c = n[x].left;
+    else
+      c = n[n[x].left].priority > n[n[x].right].priority ? n[x].left : n[x].right;
+    sweep_rotate_up(s, c);
+  }
+
+  int p = n[x].parent;
+  if (p < 0)
+    s->root = -1;
+  else if (n[p].left == x)
+    n[p].left = -1;
+  else
+    n[p].right = -1;
+}
+
+static int sweep_next(sweep_t* s, int x)
+{
+  sweep_node_t* n = s->nodes;
+  if (n[x].right >= 0)
+  {
+    x = n[x].right;
+    while (n[x].left >= 0)
+      x = n[x].left;
+    return x;
+  }
+  while (n[x].parent >= 0 && n[n[x].parent].right == x)
+    x = n[x].parent;
+  return n[x].parent;
+}
+
+static int sweep_prev(sweep_t* s, int x)
+{
+  sweep_node_t* n = s->nodes;
+  if (n[x].left >= 0)
+  {
+    x = n[x].left;
+    while (n[x].right >= 0)
+      x = n[x].right;
+    return x;
+  }
+  while (n[x].parent >= 0 && n[n[x].parent].left == x)
+    x = n[x].parent;
+  return n[x].parent;
+}
+
+static bool sweep_check(sweep_t* s, int a, int b, size_t* edge_a, size_t* edge_b)
+{
+  if (a < 0 || b < 0)
+    return false;
+  if (!lines_intersect(s->nodes[a].l, s->nodes[a].r, s->nodes[b].l, s->nodes[b].r))
+    return false;
+  
+  if (edge_a)
+    *edge_a = a < b ? a : b;
+  if (edge_b)
+    *edge_b = a < b ? b : a;
+  return true;
+}
+
+bool poly_find_self_intersection(polygon_t* p, size_t* edge_a, size_t* edge_b)
+{
+  if (p->num_edges < 2)
+    return false;
+  
+  sweep_t s;
+  s.root = -1;
+  s.nodes = (sweep_node_t*) malloc(sizeof(sweep_node_t) * p->num_edges);
+  sweep_event_t* events = (sweep_event_t*) malloc(sizeof(sweep_event_t) * p->num_edges * 2);
+  
+  size_t num_events = 0;
+  for (int i = 0; i < p->num_edges; i++)
+  {
+    point_t u1 = p->points[i];
+    point_t u2 = p->points[(i + 1) % p->num_points];
+
+    // Zero length edges cannot cross anything
+    if (u1.x == u2.x && u1.y == u2.y)
+      continue;
     
-    if (lines_intersect(*u1, *u2, l1, l2))
+    sweep_node_t* node = s.nodes + i;
+    node->l = point_less(u1, u2) ? u1 : u2;
+    node->r = point_less(u1, u2) ? u2 : u1;
+    node->priority = (unsigned int) i * 2654435761u;
+
+    sweep_event_t e;
+    e.edge = i;
+    e.x = node->l.x;
+    e.y = node->l.y;
+    e.remove = false;
+    events[num_events++] = e;
+    
+    e.x = node->r.x;
+    e.y = node->r.y;
+    e.remove = true;
+    events[num_events++] = e;
+  }
+
+  qsort(events, num_events, sizeof(sweep_event_t), sweep_event_comparator);
+
+  bool found = false;
+  for (size_t i = 0; i < num_events && !found; i++)
+  {
+    int edge = events[i].edge;
+    if (events[i].remove)
     {
-      return true;
+      found = sweep_check(&s, sweep_prev(&s, edge), sweep_next(&s, edge), edge_a, edge_b);
+      sweep_remove(&s, edge);
+    }
+    else
+    {
+      sweep_insert(&s, edge);
+      found = sweep_check(&s, edge, sweep_prev(&s, edge), edge_a, edge_b)
+        || sweep_check(&s, edge, sweep_next(&s, edge), edge_a, edge_b);
     }
   }
-  return false;
+
+  free(events);
+  free(s.nodes);
+  return found;
 }
 
 bool poly_self_intersect(polygon_t* p)
 {
-  for (int j = 0; j < p->num_edges; j++)
+  return poly_find_self_intersection(p, NULL, NULL);
+}
+
+// Triangulation
+//
+// Convex polygons are cut up directly. Other simple polygons are first
+// split into pieces monotone in x by a sweep from left to right (de Berg
+// et al., chapter 3). The sweep keeps the edges that have the interior
+// above them in the treap of the self intersection test, each with a
+// helper: the last vertex seen between it and the next edge up. Vertices
+// where the outline turns back in x with the interior reaching past them
+// (split and merge vertices) get a diagonal to a helper. Each piece is
+// then triangulated in one pass along its two chains, O(n log n) overall.
+
+// Highest edge in the sweep below p, or -1
+static int sweep_find_below(sweep_t* s, point_t p)
+{
+  sweep_node_t* n = s->nodes;
+  int found = -1;
+  for (int cur = s->root; cur >= 0;)
   {
-    // edge 1
-    point_t* u1 = p->points + j;
-    point_t* u2 = p->points + ((j +  1) % p->num_points);
-    
-    if (line_poly_intersect(*u1, *u2, p))
+    if (line_coefficient(p, n[cur].l, n[cur].r) <= 0)
     {
-      return true;
+      found = cur;
+      cur = n[cur].right;
     }
+    else
+      cur = n[cur].left;
   }
-  return false;
+  return found;
+}
+
+typedef struct
+{
+  int* ring;        // point of each vertex, counterclockwise
+  point_t* points;  // by vertex
+  int* order;       // position of each vertex in sweep order
+  int n;
+  sweep_t sweep;    // node i is the edge from vertex i to i + 1
+  bool* in_sweep;
+  int* helper;      // by edge
+  bool* merge;      // by vertex
+  int* diagonals;   // vertex pairs
+  int* triangles;   // vertex triples
+  int num_triangles;
+  double area;      // of the triangles, doubled
+} triangulation_t;
+
+static point_t tri_point(const triangulation_t* t, int v)
+{
+  return t->points[v];
+}
+
+static bool tri_before(const triangulation_t* t, int a, int b)
+{
+  return t->order[a] < t->order[b];
+}
+
+// Positive when a, b, c turn counterclockwise
+static double tri_turn(const triangulation_t* t, int a, int b, int c)
+{
+  return -line_coefficient(tri_point(t, c), tri_point(t, a), tri_point(t, b));
+}
+
+static void tri_add_edge(triangulation_t* t, int e)
+{
+  sweep_node_t* node = t->sweep.nodes + e;
+  node->l = tri_point(t, e);
+  node->r = tri_point(t, e + 1 < t->n ? e + 1 : 0);
+  node->priority = (unsigned int) e * 2654435761u;
+  sweep_insert(&t->sweep, e);
+  t->in_sweep[e] = true;
+  t->helper[e] = e;
+}
+
+static void tri_add_diagonal(triangulation_t* t, int a, int b)
+{
+  sb_push(t->diagonals, a);
+  sb_push(t->diagonals, b);
+}
+
+// Edge e ends at v
+static bool tri_end_edge(triangulation_t* t, int e, int v)
+{
+  if (!t->in_sweep[e])
+    return false;
+  if (t->merge[t->helper[e]])
+    tri_add_diagonal(t, v, t->helper[e]);
+  sweep_remove(&t->sweep, e);
+  t->in_sweep[e] = false;
+  return true;
+}
+
+// v becomes the helper of the edge below it
+static bool tri_help_below(triangulation_t* t, int v)
+{
+  int e = sweep_find_below(&t->sweep, tri_point(t, v));
+  if (e < 0)
+    return false;
+  if (t->merge[t->helper[e]])
+    tri_add_diagonal(t, v, t->helper[e]);
+  t->helper[e] = v;
+  return true;
+}
+
+static bool tri_sweep_vertex(triangulation_t* t, int v)
+{
+  int prev = v ? v - 1 : t->n - 1;
+  int next = v + 1 < t->n ? v + 1 : 0;
+  bool from_left = tri_before(t, prev, v);
+  bool to_right = tri_before(t, v, next);
+  bool reflex = tri_turn(t, prev, v, next) < 0;
+
+  if (!from_left && to_right)
+  {
+    // Start vertex, or split vertex if the interior reaches past it
+    if (reflex)
+    {
+      int e = sweep_find_below(&t->sweep, tri_point(t, v));
+      if (e < 0)
+        return false;
+      tri_add_diagonal(t, v, t->helper[e]);
+      t->helper[e] = v;
+    }
+    tri_add_edge(t, v);
+  }
+  else if (from_left && !to_right)
+  {
+    // End vertex, or merge vertex if the interior reaches past it
+    if (!tri_end_edge(t, prev, v))
+      return false;
+    if (reflex)
+    {
+      if (!tri_help_below(t, v))
+        return false;
+      t->merge[v] = true;
+    }
+  }
+  else if (from_left)
+  {
+    // On the bottom of the interior
+    if (!tri_end_edge(t, prev, v))
+      return false;
+    tri_add_edge(t, v);
+  }
+  else if (!tri_help_below(t, v))
+    return false;
+  return true;
+}
+
+static bool tri_emit(triangulation_t* t, int a, int b, int c, int max_triangles)
+{
+  if (t->num_triangles >= max_triangles)
+    return false;
+
+  double area = tri_turn(t, a, b, c);
+  int* dst = t->triangles + (t->num_triangles++ * 3);
+  dst[0] = a;
+  dst[1] = area < 0 ? c : b;
+  dst[2] = area < 0 ? b : c;
+  t->area += fabs(area);
+  return true;
+}
+
+// Triangulates a piece monotone in x, given counterclockwise. Its two
+// chains are merged into sweep order, then each vertex is joined to the
+// vertices on a stack it can see. sorted and stack hold num_vertices.
+static bool tri_monotone(triangulation_t* t, const int* piece, int num_vertices,
+                         int* sorted, int* stack)
+{
+  if (num_vertices < 3)
+    return false;
+
+  int lo = 0;
+  int hi = 0;
+  for (int i = 1; i < num_vertices; i++)
+  {
+    if (tri_before(t, piece[i], piece[lo]))
+      lo = i;
+    if (tri_before(t, piece[hi], piece[i]))
+      hi = i;
+  }
+
+  // The chain after lo, going counterclockwise, is stored as vertex + 1
+  // so the side of each sorted vertex is known, the one before as -vertex - 1
+  int a = lo + 1 < num_vertices ? lo + 1 : 0;
+  int b = lo ? lo - 1 : num_vertices - 1;
+  sorted[0] = piece[lo] + 1;
+  for (int i = 1; i < num_vertices; i++)
+  {
+    if (a != hi && (b == hi || tri_before(t, piece[a], piece[b])))
+    {
+      sorted[i] = piece[a] + 1;
+      a = a + 1 < num_vertices ? a + 1 : 0;
+    }
+    else
+    {
+      sorted[i] = -piece[b] - 1;
+      b = b ? b - 1 : num_vertices - 1;
+    }
+    if (!tri_before(t, abs(sorted[i - 1]) - 1, abs(sorted[i]) - 1))
+      return false;
+  }
+
+  int max_triangles = t->num_triangles + num_vertices - 2;
+  if (max_triangles > t->n - 2)
+    return false;
+  int top = 0;
+  stack[top++] = sorted[0];
+  stack[top++] = sorted[1];
+  for (int i = 2; i < num_vertices; i++)
+  {
+    int u = abs(sorted[i]) - 1;
+    if (i == num_vertices - 1 || (sorted[i] > 0) != (stack[top - 1] > 0))
+    {
+      // Everything on the stack is in view across the piece
+      for (int j = 0; j + 1 < top; j++)
+      {
+        if (!tri_emit(t, u, abs(stack[j]) - 1, abs(stack[j + 1]) - 1, max_triangles))
+          return false;
+      }
+      stack[0] = stack[top - 1];
+      stack[1] = sorted[i];
+      top = 2;
+    }
+    else
+    {
+      // Cut off the stack vertices that turn towards the interior
+      int last = stack[--top];
+      while (top > 0)
+      {
+        int p = abs(stack[top - 1]) - 1;
+        int q = abs(last) - 1;
+        double turn = sorted[i] > 0 ? tri_turn(t, p, q, u) : tri_turn(t, u, q, p);
+        if (turn <= 0)
+          break;
+        if (!tri_emit(t, p, q, u, max_triangles))
+          return false;
+        last = stack[--top];
+      }
+      stack[top++] = last;
+      stack[top++] = sorted[i];
+    }
+  }
+  return t->num_triangles == max_triangles;
+}
+
+// Edge out of a vertex, keyed by its direction
+typedef struct
+{
+  double angle;
+  int vertex;
+} tri_out_t;
+
+// Increases with the angle of (dx, dy) counterclockwise from the x axis,
+// in [0, 4): the quadrant plus how far the direction is through it
+static double pseudo_angle(double dx, double dy)
+{
+  if (dy >= 0)
+    return dx >= 0 ? dy / (dx + dy) : 1 + (-dx / (dy - dx));
+  return dx < 0 ? 2 + (-dy / (-dx - dy)) : 3 + (dx / (dx - dy));
+}
+
+static int tri_out_comparator(const void* p_a, const void* p_b)
+{
+  const tri_out_t* a = (const tri_out_t*) p_a;
+  const tri_out_t* b = (const tri_out_t*) p_b;
+
+  if (a->angle != b->angle)
+    return a->angle < b->angle ? -1 : 1;
+  return a->vertex - b->vertex;
+}
+
+// Walks the pieces the diagonals split the polygon into and triangulates
+// each. The vertices around a piece are found by taking the first edge
+// clockwise from the one arriving at each vertex.
+static bool tri_pieces(triangulation_t* t)
+{
+  int n = t->n;
+  int num_diagonals = sb_count(t->diagonals) / 2;
+  int* offsets = (int*) calloc(n + 1, sizeof(int));
+  int* out = (int*) malloc(sizeof(int) * (2 * (n + num_diagonals)));
+  bool* walked = (bool*) calloc(2 * (n + num_diagonals), sizeof(bool));
+  int* piece = (int*) malloc(sizeof(int) * 3 * n);
+
+  // Edges out of each vertex, in counterclockwise order
+  for (int v = 0; v < n; v++)
+    offsets[v + 1] = 2;
+  for (int i = 0; i < 2 * num_diagonals; i++)
+    offsets[t->diagonals[i] + 1]++;
+  for (int v = 0; v < n; v++)
+  {
+    offsets[v + 1] += offsets[v];
+    out[offsets[v]] = v ? v - 1 : n - 1;
+    out[offsets[v] + 1] = v + 1 < n ? v + 1 : 0;
+  }
+  int* fill = (int*) malloc(sizeof(int) * n);
+  for (int v = 0; v < n; v++)
+    fill[v] = offsets[v] + 2;
+  for (int i = 0; i < num_diagonals; i++)
+  {
+    int a = t->diagonals[2 * i];
+    int b = t->diagonals[(2 * i) + 1];
+    out[fill[a]++] = b;
+    out[fill[b]++] = a;
+  }
+  free(fill);
+
+  // Only vertices with diagonals need sorting
+  tri_out_t* around = (tri_out_t*) malloc(sizeof(tri_out_t) * (2 * (n + num_diagonals)));
+  for (int v = 0; v < n; v++)
+  {
+    int first = offsets[v];
+    int count = offsets[v + 1] - first;
+    if (count == 2)
+      continue;
+    point_t o = tri_point(t, v);
+    for (int i = 0; i < count; i++)
+    {
+      point_t p = tri_point(t, out[first + i]);
+      around[i].angle = pseudo_angle((double) p.x - o.x, (double) p.y - o.y);
+      around[i].vertex = out[first + i];
+    }
+    qsort(around, count, sizeof(tri_out_t), tri_out_comparator);
+    for (int i = 0; i < count; i++)
+      out[first + i] = around[i].vertex;
+  }
+  free(around);
+
+  bool ok = true;
+  int* sorted = piece + n;
+  int* stack = piece + (2 * n);
+  for (int v = 0; v < n && ok; v++)
+  {
+    int prev = v ? v - 1 : n - 1;
+    for (int start = offsets[v]; start < offsets[v + 1] && ok; start++)
+    {
+      // Edges back to the previous vertex have the outside on their left
+      if (walked[start] || out[start] == prev)
+        continue;
+
+      int num_vertices = 0;
+      int from = v;
+      int edge = start;
+      do
+      {
+        walked[edge] = true;
+        if (num_vertices == n)
+        {
+          ok = false;
+          break;
+        }
+        piece[num_vertices++] = from;
+
+        int to = out[edge];
+        int first = offsets[to];
+        int count = offsets[to + 1] - first;
+        int back = 0;
+        while (back < count && out[first + back] != from)
+          back++;
+        if (back == count)
+        {
+          ok = false;
+          break;
+        }
+        edge = first + (back ? back - 1 : count - 1);
+        from = to;
+      }
+      while (edge != start);
+
+      ok = ok && tri_monotone(t, piece, num_vertices, sorted, stack);
+    }
+  }
+
+  free(piece);
+  free(walked);
+  free(out);
+  free(offsets);
+  return ok;
+}
+
+// Triangulates a simple polygon into t->triangles, given the vertices
+// without repeated points
+static bool tri_simple(triangulation_t* t, double area)
+{
+  int n = t->n;
+  t->sweep.root = -1;
+  t->sweep.nodes = (sweep_node_t*) malloc(sizeof(sweep_node_t) * n);
+  t->in_sweep = (bool*) calloc(n, sizeof(bool));
+  t->helper = (int*) malloc(sizeof(int) * n);
+  t->merge = (bool*) calloc(n, sizeof(bool));
+  t->diagonals = NULL;
+  t->num_triangles = 0;
+  t->area = 0;
+
+  // Ties between equal points are broken by vertex
+  sweep_event_t* events = (sweep_event_t*) malloc(sizeof(sweep_event_t) * n);
+  for (int v = 0; v < n; v++)
+  {
+    point_t p = tri_point(t, v);
+    events[v].x = p.x;
+    events[v].y = p.y;
+    events[v].edge = v;
+    events[v].remove = false;
+  }
+  qsort(events, n, sizeof(sweep_event_t), sweep_event_comparator);
+  t->order = (int*) malloc(sizeof(int) * n);
+  for (int i = 0; i < n; i++)
+    t->order[events[i].edge] = i;
+
+  bool ok = true;
+  for (int i = 0; i < n && ok; i++)
+    ok = tri_sweep_vertex(t, events[i].edge);
+  ok = ok && tri_pieces(t);
+
+  // A polygon that touches itself can get through the sweep with pieces
+  // that overlap, which shows up in the area
+  ok = ok && t->num_triangles == n - 2 && fabs(t->area - area) <= area * 1e-6;
+
+  free(events);
+  free(t->order);
+  if (t->diagonals)
+    sb_free(t->diagonals);
+  free(t->merge);
+  free(t->helper);
+  free(t->in_sweep);
+  free(t->sweep.nodes);
+  return ok;
+}
+
+// Cuts off every other corner, then again around what is left, so the
+// triangles stay fat rather than fanning out of one corner
+static void tri_convex(polygon_t* poly)
+{
+  size_t n = poly->num_points;
+  int* ring = (int*) malloc(sizeof(int) * n);
+  for (size_t i = 0; i < n; i++)
+    ring[i] = i;
+  poly->triangles = (int*) realloc(poly->triangles, sizeof(int) * 3 * (n - 2));
+
+  int* t = poly->triangles;
+  while (n > 2)
+  {
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      if ((i & 1) && i + 1 < n)
+      {
+        *t++ = ring[i - 1];
+        *t++ = ring[i];
+        *t++ = ring[i + 1];
+      }
+      else
+        ring[kept++] = ring[i];
+    }
+    n = kept;
+  }
+  free(ring);
+  poly->num_triangles = poly->num_points - 2;
+}
+
+static void tri_polygon(polygon_t* poly)
+{
+  size_t n = poly->num_points;
+  triangulation_t t;
+  t.ring = (int*) malloc(sizeof(int) * n);
+  t.points = (point_t*) malloc(sizeof(point_t) * n);
+  t.n = 0;
+
+  // Repeated points would leave edges with no direction to sweep by
+  double area = 0;
+  point_t o = poly->points[0];
+  for (size_t i = 0; i < n; i++)
+  {
+    point_t p = poly->points[i];
+    point_t q = poly->points[(i + 1) % n];
+    if (p.x == q.x && p.y == q.y)
+      continue;
+    t.ring[t.n] = i;
+    t.points[t.n++] = p;
+    area += (((double) p.x - o.x) * ((double) q.y - o.y)) - (((double) p.y - o.y) * ((double) q.x - o.x));
+  }
+
+  bool reversed = area < 0;
+  if (reversed)
+  {
+    area = -area;
+    for (int i = 0, j = t.n - 1; i < j; i++, j--)
+    {
+      int v = t.ring[i];
+      t.ring[i] = t.ring[j];
+      t.ring[j] = v;
+      point_t p = t.points[i];
+      t.points[i] = t.points[j];
+      t.points[j] = p;
+    }
+  }
+
+  if (t.n >= 3 && area > 0)
+  {
+    t.triangles = (int*) realloc(poly->triangles, sizeof(int) * 3 * (t.n - 2));
+    poly->triangles = t.triangles;
+    if (tri_simple(&t, area))
+    {
+      // Back to points, wound the way the polygon is
+      for (int i = 0; i < t.num_triangles * 3; i += 3)
+      {
+        int a = t.ring[t.triangles[i]];
+        int b = t.ring[t.triangles[i + 1]];
+        int c = t.ring[t.triangles[i + 2]];
+        t.triangles[i] = a;
+        t.triangles[i + 1] = reversed ? c : b;
+        t.triangles[i + 2] = reversed ? b : c;
+      }
+      poly->num_triangles = t.num_triangles;
+    }
+  }
+  free(t.points);
+  free(t.ring);
+}
+
+const int* polygon_triangles(polygon_t* poly, size_t* num_triangles)
+{
+  if (poly->triangles_version != poly->version)
+  {
+    poly->num_triangles = 0;
+    if (poly->closed && poly->num_points >= 3)
+    {
+      if (polygon_is_convex(poly))
+        tri_convex(poly);
+      else if (!polygon_is_complex(poly))
+        tri_polygon(poly);
+    }
+    poly->triangles_version = poly->version;
+  }
+
+  *num_triangles = poly->num_triangles;
+  return poly->num_triangles ? poly->triangles : NULL;
 }
@@ -9,22 +9,150 @@ typedef struct point_t
 } point_t;
 
 typedef struct
+{
+  point_t min;
+  point_t max;
+} aabb_t;
+
+// Edge table entry for scan conversion. An edge crosses the scanlines
+// [y_start, y_end); flat edges only count on their own scanline.
+typedef struct
+{
+  int index;      // edge index in the polygon
+  bool flat;
+  double y_start;
+  double y_end;
+  double dxdy;    // x step per scanline
+} edge_t;
+
+// A run of pixels [x0, x1) on row y
+typedef struct
+{
+  int y;
+  int x0;
+  int x1;
+} span_t;
+
+// Spans of a scan fill, see scan_fill_spans
+typedef struct
+{
+  unsigned int version;
+  size_t w, h; // display size they were made for
+  span_t* spans; // by row
+} span_cache_t;
+
+struct bvh_t;
+
+typedef struct polygon_t
 {
   point_t* points;
   size_t num_points;
   size_t num_edges;
   bool complex;
   bool closed;
+
+  // Bumped by every edit. Derived data is tagged with the version it was
+  // computed at, and is only recomputed once it goes stale.
+  unsigned int version;
+  
+  unsigned int complex_version;
+
+  unsigned int shape_version;
+  bool convex;
+  bool monotone;
+  
+  unsigned int bounds_version;
+  aabb_t bounds;
+  
+  unsigned int edges_version;
+  edge_t* edges; // sorted by y_start
+  size_t num_table_edges;
+
+  unsigned int bvh_version;
+  struct bvh_t* bvh; // over the edge bounds, item i is edge i
+
+  unsigned int triangles_version;
+  int* triangles; // index triples into points
+  size_t num_triangles;
+
+  unsigned int clip_version;
+  aabb_t clip_box;
+  struct polygon_t* clipped;
+
+  span_cache_t span_caches[2]; // by fill rule, kept by draw.c
 } polygon_t;
 
 void create_polygon(polygon_t* poly);
 
+// Builds a closed polygon from an outline in one go
+void create_polygon_from_points(polygon_t* poly, const point_t* points, size_t num_points);
+
 void polygon_add_point(polygon_t* poly, point_t point);
 
 void polygon_close(polygon_t* poly, point_t point);
 
 void delete_polygon(polygon_t* poly);
 
+// Call after moving points directly, invalidates all derived data
+void polygon_touch(polygon_t* poly);
+
+// Cached self intersection test, see poly_self_intersect
+bool polygon_is_complex(polygon_t* poly);
+
+// Cached shape tests. A polygon is monotone when its outline only turns
+// back in y at its top and bottom, so it crosses every row at most twice,
+// and convex when it is monotone and turns the same way at every vertex.
+bool polygon_is_convex(polygon_t* poly);
+bool polygon_is_monotone(polygon_t* poly);
+
+aabb_t polygon_bounds(polygon_t* poly);
+
+// Cached edge table, sorted by the first scanline each edge crosses. Edges
+// that cross no scanline are left out.
+const edge_t* polygon_edge_table(polygon_t* poly, size_t* num_edges);
+
+// Cached edge BVH. Moving points only refits it, adding points rebuilds it.
+const struct bvh_t* polygon_edge_bvh(polygon_t* poly);
+
+// Cached triangulation of a closed polygon that does not cross itself, as
+// num_triangles index triples into its points, wound the way the polygon
+// is. Convex polygons are cut up directly, others are split into monotone
+// pieces by a sweep in O(n log n). NULL for self intersecting polygons and
+// the ones with no area, or that touch themselves in a way the sweep
+// cannot split.
+const int* polygon_triangles(polygon_t* poly, size_t* num_triangles);
+
+// Cached copy of a closed polygon clipped to a box by Sutherland-Hodgman,
+// or the polygon itself if it already lies within the box. Clipping keeps
+// the winding of every point inside the box, so either fill rule fills the
+// clipped polygon the same there. The box edges become edges of the copy.
+polygon_t* polygon_clipped(polygon_t* poly, aabb_t box);
+
+// Even-odd point in polygon test for closed polygons
+bool polygon_contains_point(polygon_t* poly, point_t point);
+
+// Closest edge within max_d of point, or -1. The distance is written to
+// dist if it is not NULL.
+int polygon_nearest_edge(polygon_t* poly, point_t point, float max_d, float* dist);
+
+// Scene wide index over the bounds of an array of polygons, refit in place
+// as long as the polygon count does not change
+void polygon_set_update_bvh(struct bvh_t* bvh, polygon_t* polys, size_t num_polys);
+
+struct job_pool_t;
+
+// Brings the bounds, shape, edge table and edge BVH of every polygon up to date,
+// one polygon per job. pool may be NULL. Self intersection is only tested
+// on demand, see polygon_is_complex.
+void polygon_set_update_caches(polygon_t* polys, size_t num_polys, struct job_pool_t* pool);
+
+// Lowest index polygon with an edge crossing the segment, or -1
+int polygon_set_segment_intersect(const struct bvh_t* bvh, polygon_t* polys,
+                                  point_t l1, point_t l2);
+
+// Highest index, so topmost, closed polygon containing point, or -1
+int polygon_set_find_containing(const struct bvh_t* bvh, polygon_t* polys, point_t point);
+
 bool lines_intersect(point_t u1, point_t u2,
                      point_t p1, point_t p2);
 
@@ -32,3 +160,8 @@ bool line_poly_intersect(point_t l1, point_t l2,
                          polygon_t* p);
   
 bool poly_self_intersect(polygon_t* p);
+
+// Sweep line test for a pair of edges that cross, in O(n log n). The
+// edge indices of the first pair found are written to edge_a and edge_b,
+// either may be NULL.
+bool poly_find_self_intersection(polygon_t* p, size_t* edge_a, size_t* edge_b);
@@ -1,18 +1,99 @@
 #include "gl_pixel_display.h"
 
-void create_pixel_display(pixel_display_t* display, size_t w, size_t h)
+// The pixels live in a persistent CPU buffer, so only the regions drawn
+// this frame need to be redrawn and uploaded
+static void gl_fill_start(pixel_display_t* display)
 {
-  glGenTextures(1, &display->tex);
-  glGenBuffers(2, display->pbo);
+}
+
+// Packs the dirty rects into the next PBO and updates just those regions
+// of the texture from it
+static void gl_fill_end(pixel_display_t* display)
+{
+  gl_pixel_display_t* gl = (gl_pixel_display_t*) display->backend_data;
+  rect_list_t* dirty = &display->dirty;
+  if (!dirty->count)
+    return;
+  
+  size_t size = 0;
+  for (int i = 0; i < dirty->count; i++)
+  {
+    rect_t r = dirty->rects[i];
+    size += sizeof(pixel_t) * (r.x1 - r.x0) * (r.y1 - r.y0);
+  }
+  
+  int index = (++gl->current_buff) % NUM_PIX_BUFFERS;
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo[index]);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW);
+  
+  pixel_t* dst = (pixel_t*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (!dst)
+  {
+    fprintf(stderr, "Failed to map pixel buffer\n");
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return;
+  }
+
+  pixel_t* out = dst;
+  for (int i = 0; i < dirty->count; i++)
+  {
+    rect_t r = dirty->rects[i];
+    size_t row = r.x1 - r.x0;
+    for (int y = r.y0; y < r.y1; y++)
+    {
+      memcpy(out, display->buf + r.x0 + (y * display->w), sizeof(pixel_t) * row);
+      out += row;
+    }
+  }
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  glBindTexture(GL_TEXTURE_2D, gl->tex);
+  size_t offset = 0;
+  for (int i = 0; i < dirty->count; i++)
+  {
+    rect_t r = dirty->rects[i];
+    glTexSubImage2D(GL_TEXTURE_2D, 0, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0,
+                    GL_BGRA, GL_UNSIGNED_BYTE, (void*) offset);
+    offset += sizeof(pixel_t) * (r.x1 - r.x0) * (r.y1 - r.y0);
+  }
+  
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+static void gl_destroy(pixel_display_t* display)
+{
+  gl_pixel_display_t* gl = (gl_pixel_display_t*) display->backend_data;
+  
+  glDeleteTextures(1, &gl->tex);
+  glDeleteBuffers(NUM_PIX_BUFFERS, gl->pbo);
+
+  pixel_free(display->buf);
+  free(gl);
+}
+
+static const pixel_display_backend_t gl_backend = {
+  .fill_start = gl_fill_start,
+  .fill_end = gl_fill_end,
+  .destroy = gl_destroy
+};
+
+void create_gl_pixel_display(pixel_display_t* display, size_t w, size_t h)
+{
+  gl_pixel_display_t* gl = (gl_pixel_display_t*) malloc(sizeof(gl_pixel_display_t));
+  
+  glGenTextures(1, &gl->tex);
+  glGenBuffers(NUM_PIX_BUFFERS, gl->pbo);
 
   // Double buffered pbo init
   for (int i = 0; i < NUM_PIX_BUFFERS; i++)
   {
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, display->pbo[i]);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo[i]);
     glBufferData(GL_PIXEL_UNPACK_BUFFER, sizeof(pixel_t) * w * h, 0, GL_STREAM_DRAW);
   }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 
-  glBindTexture(GL_TEXTURE_2D, display->tex);
+  glBindTexture(GL_TEXTURE_2D, gl->tex);
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -21,46 +102,28 @@ void create_pixel_display(pixel_display_t* display, size_t w, size_t h)
   
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
 
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-
   // Init buff counter
-  display->current_buff = 0;
+  gl->current_buff = 0;
 
   display->w = w;
   display->h = h;
 
-  display->buf = NULL;
-}
-
-void delete_pixel_display(pixel_display_t* display)
-{
-  glDeleteTextures(1, &display->tex);
-  glDeleteBuffers(2, display->pbo);
-}
-
-void pixel_display_fill_start(pixel_display_t* display)
-{
-  int index = (++display->current_buff) % NUM_PIX_BUFFERS;
-  int next_index = (index + 1) % NUM_PIX_BUFFERS;
+  display->buf = (pixel_t*) pixel_alloc(sizeof(pixel_t) * w * h);
+  memset(display->buf, 0, sizeof(pixel_t) * w * h);
   
-  glBindTexture(GL_TEXTURE_2D, display->tex);
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, display->pbo[index]);
-
-  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, display->w, display->h,
-                  GL_BGRA, GL_UNSIGNED_BYTE, 0);
+  // The texture starts out undefined, so the first upload is the whole frame
+  display->dirty.count = 0;
+  display->quality = QUALITY_ALIASED;
+  display->blend = BLEND_REPLACE;
+  pixel_display_reset_clip(display);
+  pixel_display_damage(display, display->clip);
 
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, display->pbo[next_index]);
-  glBufferData(GL_PIXEL_UNPACK_BUFFER, sizeof(pixel_t) * display->w * display->h, 0, GL_STREAM_DRAW);
-
-  display->buf = (pixel_t*) glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
-  
-  // Possibly handle null buf
+  display->backend = &gl_backend;
+  display->backend_data = gl;
 }
 
-void pixel_display_fill_end(pixel_display_t* display)
+GLuint gl_pixel_display_texture(pixel_display_t* display)
 {
-  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-
-  display->buf = NULL;
+  gl_pixel_display_t* gl = (gl_pixel_display_t*) display->backend_data;
+  return gl->tex;
 }
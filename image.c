@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "image.h"
+
+bool write_ppm(const char* pathname, pixel_display_t* display)
+{
+  FILE* file = fopen(pathname, "wb");
+  if (!file)
+  {
+    fprintf(stderr, "Unable to open file %s.\n", pathname);
+    return false;
+  }
+
+  fprintf(file, "P6\n%zu %zu\n255\n", display->w, display->h);
+
+  unsigned char* row = (unsigned char*) malloc(display->w * 3);
+  bool ok = true;
+  for (size_t y = 0; y < display->h && ok; y++)
+  {
+    pixel_t* src = display->buf + (y * display->w);
+    for (size_t x = 0; x < display->w; x++)
+    {
+      row[x * 3] = src[x].r;
+      row[x * 3 + 1] = src[x].g;
+      row[x * 3 + 2] = src[x].b;
+    }
+    ok = fwrite(row, 3, display->w, file) == display->w;
+  }
+  free(row);
+
+  if (fclose(file) || !ok)
+  {
+    fprintf(stderr, "Write error when writing %s.\n", pathname);
+    return false;
+  }
+  return true;
+}
+
+// QOI encoder
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+
+static size_t qoi_put_u32(unsigned char* out, unsigned int v)
+{
+  out[0] = (v >> 24) & 0xff;
+  out[1] = (v >> 16) & 0xff;
+  out[2] = (v >> 8) & 0xff;
+  out[3] = v & 0xff;
+  return 4;
+}
+
+static int qoi_hash(pixel_t p)
+{
+  return (p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) % 64;
+}
+
+bool write_qoi(const char* pathname, pixel_display_t* display)
+{
+  size_t num_pixels = display->w * display->h;
+  
+  // Worst case is an RGBA op per pixel, plus header and end marker
+  unsigned char* data = (unsigned char*) malloc(14 + num_pixels * 5 + 8);
+  size_t n = 0;
+
+  memcpy(data, "qoif", 4);
+  n += 4;
+  n += qoi_put_u32(data + n, display->w);
+  n += qoi_put_u32(data + n, display->h);
+  data[n++] = 4; // channels
+  data[n++] = 0; // sRGB
+
+  pixel_t index[64];
+  memset(index, 0, sizeof(index));
+  
+  pixel_t prev = {.r = 0, .g = 0, .b = 0, .a = 255};
+  int run = 0;
+  
+  for (size_t i = 0; i < num_pixels; i++)
+  {
+    pixel_t px = display->buf[i];
+    
+    if (!memcmp(&px, &prev, sizeof(pixel_t)))
+    {
+      run++;
+      if (run == 62 || i == num_pixels - 1)
+      {
+        data[n++] = QOI_OP_RUN | (run - 1);
+        run = 0;
+      }
+      continue;
+    }
+
+    if (run)
+    {
+      data[n++] = QOI_OP_RUN | (run - 1);
+      run = 0;
+    }
+
+    int hash = qoi_hash(px);
+    if (!memcmp(index + hash, &px, sizeof(pixel_t)))
+    {
+      data[n++] = QOI_OP_INDEX | hash;
+    }
+    else
+    {
+      index[hash] = px;
+      
+      if (px.a == prev.a)
+      {
+        signed char vr = px.r - prev.r;
+        signed char vg = px.g - prev.g;
+        signed char vb = px.b - prev.b;
+        signed char vg_r = vr - vg;
+        signed char vg_b = vb - vg;
+
+        if (vr > -3 && vr < 2
+            && vg > -3 && vg < 2
+            && vb > -3 && vb < 2)
+        {
+          data[n++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+        }
+        else if (vg_r > -9 && vg_r < 8
+                 && vg > -33 && vg < 32
+                 && vg_b > -9 && vg_b < 8)
+        {
+          data[n++] = QOI_OP_LUMA | (vg + 32);
+          data[n++] = (vg_r + 8) << 4 | (vg_b + 8);
+        }
+        else
+        {
+          data[n++] = QOI_OP_RGB;
+          data[n++] = px.r;
+          data[n++] = px.g;
+          data[n++] = px.b;
+        }
+      }
+      else
+      {
+        data[n++] = QOI_OP_RGBA;
+        data[n++] = px.r;
+        data[n++] = px.g;
+        data[n++] = px.b;
+        data[n++] = px.a;
+      }
+    }
+    prev = px;
+  }
+
+  static const unsigned char end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+  memcpy(data + n, end_marker, sizeof(end_marker));
+  n += sizeof(end_marker);
+
+  FILE* file = fopen(pathname, "wb");
+  if (!file)
+  {
+    fprintf(stderr, "Unable to open file %s.\n", pathname);
+    free(data);
+    return false;
+  }
+  
+  bool ok = fwrite(data, 1, n, file) == n;
+  free(data);
+  
+  if (fclose(file) || !ok)
+  {
+    fprintf(stderr, "Write error when writing %s.\n", pathname);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "pixel_display.h"
+
+// Binary PPM (P6), alpha is dropped
+bool write_ppm(const char* pathname, pixel_display_t* display);
+
+// QOI, see https://qoiformat.org
+bool write_qoi(const char* pathname, pixel_display_t* display);
@@ -0,0 +1,334 @@
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "job.h"
+
+// Pieces each loop is split into per thread, enough for stealing to even
+// out uneven work
+#define JOB_SPLITS_PER_THREAD 4
+
+#define JOB_DEQUE_INITIAL 64
+
+// Deque of the current thread, if it is a worker
+static __thread job_pool_t* tls_pool = NULL;
+static __thread int tls_deque = 0;
+
+int job_default_threads(void)
+{
+  const char* env = getenv("POLYDRAW_THREADS");
+  if (env && atoi(env) > 0)
+    return atoi(env);
+
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int) n : 1;
+}
+
+// Deques
+
+static void create_job_deque(job_deque_t* deque)
+{
+  pthread_mutex_init(&deque->lock, NULL);
+  deque->jobs = (job_t*) malloc(sizeof(job_t) * JOB_DEQUE_INITIAL);
+  deque->capacity = JOB_DEQUE_INITIAL;
+  deque->front = 0;
+  deque->count = 0;
+}
+
+static void delete_job_deque(job_deque_t* deque)
+{
+  free(deque->jobs);
+  pthread_mutex_destroy(&deque->lock);
+}
+
+// Makes room for one more job, called with the lock held
+static void job_deque_reserve(job_deque_t* deque)
+{
+  if (deque->count < deque->capacity)
+    return;
+
+  // Unwrap into a buffer twice the size
+  job_t* jobs = (job_t*) malloc(sizeof(job_t) * deque->capacity * 2);
+  for (int i = 0; i < deque->count; i++)
+    jobs[i] = deque->jobs[(deque->front + i) % deque->capacity];
+  free(deque->jobs);
+  deque->jobs = jobs;
+  deque->front = 0;
+  deque->capacity *= 2;
+}
+
+static void job_deque_push(job_deque_t* deque, job_t job)
+{
+  pthread_mutex_lock(&deque->lock);
+  job_deque_reserve(deque);
+  deque->jobs[(deque->front + deque->count) % deque->capacity] = job;
+  deque->count++;
+  pthread_mutex_unlock(&deque->lock);
+}
+
+// Puts a job back where thieves take from
+static void job_deque_push_front(job_deque_t* deque, job_t job)
+{
+  pthread_mutex_lock(&deque->lock);
+  job_deque_reserve(deque);
+  deque->front = (deque->front + deque->capacity - 1) % deque->capacity;
+  deque->jobs[deque->front] = job;
+  deque->count++;
+  pthread_mutex_unlock(&deque->lock);
+}
+
+static bool job_deque_pop_back(job_deque_t* deque, job_t* job)
+{
+  bool found = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count)
+  {
+    deque->count--;
+    *job = deque->jobs[(deque->front + deque->count) % deque->capacity];
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+static bool job_deque_pop_front(job_deque_t* deque, job_t* job)
+{
+  bool found = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count)
+  {
+    *job = deque->jobs[deque->front];
+    deque->front = (deque->front + 1) % deque->capacity;
+    deque->count--;
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+// Scheduling
+
+static int current_deque(job_pool_t* pool)
+{
+  return tls_pool == pool ? tls_deque : 0;
+}
+
+static void push_job(job_pool_t* pool, int self, job_t job)
+{
+  job_deque_push(pool->deques + self, job);
+
+  // Pairs with the sleeping check in job_worker(), one of the two sides
+  // always sees the other
+  __atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pool->sleeping, __ATOMIC_SEQ_CST))
+  {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+static bool job_ready(const job_t* job)
+{
+  return !job->after || __atomic_load_n(&job->after->pending, __ATOMIC_ACQUIRE) <= 0;
+}
+
+// Own work first, newest first, then the oldest work of the others.
+// Jobs whose after counter is still pending are not run: waiting for it
+// here could block a job it depends on further up this thread's stack.
+// They go back to the front of their deque, behind any ready work.
+static bool find_job(job_pool_t* pool, int self, job_t* job)
+{
+  for (int i = 0; i < pool->num_deques; i++)
+  {
+    job_deque_t* deque = pool->deques + ((self + i) % pool->num_deques);
+    if (!(i ? job_deque_pop_front(deque, job) : job_deque_pop_back(deque, job)))
+      continue;
+    if (job_ready(job))
+    {
+      __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+      return true;
+    }
+    job_deque_push_front(deque, *job);
+  }
+  return false;
+}
+
+static void run_job(job_pool_t* pool, int self, job_t job)
+{
+  // Leave the top half of the range for thieves until it is small enough
+  while (job.last - job.first > job.grain)
+  {
+    job_t half = job;
+    half.first = job.first + ((job.last - job.first) / 2);
+    job.last = half.first;
+    half.after = NULL;
+
+    if (job.done)
+      __atomic_add_fetch(&job.done->pending, 1, __ATOMIC_RELAXED);
+    push_job(pool, self, half);
+  }
+
+  for (int i = job.first; i < job.last; i++)
+    job.func(job.data, i);
+
+  if (job.done)
+    __atomic_sub_fetch(&job.done->pending, 1, __ATOMIC_RELEASE);
+}
+
+typedef struct
+{
+  job_pool_t* pool;
+  int index;
+} job_worker_t;
+
+static void* job_worker(void* arg)
+{
+  job_worker_t* worker = (job_worker_t*) arg;
+  job_pool_t* pool = worker->pool;
+  int self = worker->index;
+  free(worker);
+
+  tls_pool = pool;
+  tls_deque = self;
+
+  for (;;)
+  {
+    job_t job;
+    if (find_job(pool, self, &job))
+    {
+      run_job(pool, self, job);
+      continue;
+    }
+
+    // Only jobs waiting on others are queued
+    if (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) && !__atomic_load_n(&pool->quit, __ATOMIC_SEQ_CST))
+    {
+      sched_yield();
+      continue;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    __atomic_add_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+    while (!pool->quit && !__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST))
+      pthread_cond_wait(&pool->work_cond, &pool->lock);
+    __atomic_sub_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+    bool quit = pool->quit;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (quit)
+      break;
+  }
+  return NULL;
+}
+
+// Pool
+
+void create_job_pool(job_pool_t* pool, int num_threads)
+{
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_cond, NULL);
+  pool->queued = 0;
+  pool->sleeping = 0;
+  pool->quit = false;
+
+  pool->num_threads = 0;
+  pool->threads = NULL;
+  pool->num_deques = num_threads > 1 ? num_threads : 1;
+  pool->deques = (job_deque_t*) malloc(sizeof(job_deque_t) * pool->num_deques);
+  for (int i = 0; i < pool->num_deques; i++)
+    create_job_deque(pool->deques + i);
+
+  if (num_threads <= 1)
+    return;
+
+  pool->threads = (pthread_t*) malloc(sizeof(pthread_t) * (num_threads - 1));
+  for (int i = 0; i < num_threads - 1; i++)
+  {
+    job_worker_t* worker = (job_worker_t*) malloc(sizeof(job_worker_t));
+    worker->pool = pool;
+    worker->index = i + 1;
+    if (pthread_create(pool->threads + pool->num_threads, NULL, job_worker, worker))
+    {
+      free(worker);
+      break;
+    }
+    pool->num_threads++;
+  }
+}
+
+void delete_job_pool(job_pool_t* pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->work_cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->num_threads; i++)
+    pthread_join(pool->threads[i], NULL);
+  free(pool->threads);
+  pool->threads = NULL;
+  pool->num_threads = 0;
+
+  for (int i = 0; i < pool->num_deques; i++)
+    delete_job_deque(pool->deques + i);
+  free(pool->deques);
+  pool->deques = NULL;
+  pool->num_deques = 0;
+
+  pthread_cond_destroy(&pool->work_cond);
+  pthread_mutex_destroy(&pool->lock);
+}
+
+void job_run(job_pool_t* pool, int count, job_func_t func, void* data,
+             job_counter_t* after, job_counter_t* done)
+{
+  if (count <= 0)
+    return;
+
+  // Single threaded, everything before this has already run
+  if (!pool || !pool->num_threads)
+  {
+    for (int i = 0; i < count; i++)
+      func(data, i);
+    return;
+  }
+
+  job_t job;
+  job.func = func;
+  job.data = data;
+  job.first = 0;
+  job.last = count;
+  job.grain = count / (pool->num_deques * JOB_SPLITS_PER_THREAD);
+  if (job.grain < 1)
+    job.grain = 1;
+  job.after = after;
+  job.done = done;
+
+  if (done)
+    __atomic_add_fetch(&done->pending, 1, __ATOMIC_RELAXED);
+  push_job(pool, current_deque(pool), job);
+}
+
+void job_wait(job_pool_t* pool, job_counter_t* counter)
+{
+  if (!pool || !pool->num_threads)
+    return;
+
+  int self = current_deque(pool);
+  while (__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) > 0)
+  {
+    job_t job;
+    if (find_job(pool, self, &job))
+      run_job(pool, self, job);
+    else
+      sched_yield();
+  }
+}
+
+void job_parallel_for(job_pool_t* pool, int count, job_func_t func, void* data)
+{
+  job_counter_t done = {0};
+  job_run(pool, count, func, data, NULL, &done);
+  job_wait(pool, &done);
+}
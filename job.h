@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <pthread.h>
+
+// Work stealing job system
+//
+// A job calls func(data, i) for a range of indices. Every worker thread
+// owns a deque of jobs: it pushes and pops its own work at the back, and
+// idle workers steal from the front of the others. Large ranges are split
+// in half as they run, so a thief takes the biggest piece that is left.
+//
+// Completion is tracked with counters. job_run() adds to a counter and
+// job_wait() runs other jobs until it drops to zero, so jobs may start
+// and wait for more jobs themselves, and a job can be made to wait on the
+// counter of another batch before it starts. Such a job stays queued
+// until that counter drains, it is never picked up to wait.
+//
+// A pool with a single thread has no workers: jobs run right away on the
+// calling thread, in order, which makes runs repeatable for debugging.
+
+typedef void (*job_func_t)(void* data, int index);
+
+typedef struct
+{
+  int pending; // jobs submitted and not yet finished
+} job_counter_t;
+
+typedef struct
+{
+  job_func_t func;
+  void* data;
+  int first; // indices [first, last)
+  int last;
+  int grain; // ranges longer than this are split
+  job_counter_t* after;
+  job_counter_t* done;
+} job_t;
+
+// Ring buffer of jobs, the owner works at the back and thieves at the front
+typedef struct
+{
+  pthread_mutex_t lock;
+  job_t* jobs;
+  int capacity;
+  int front;
+  int count;
+} job_deque_t;
+
+typedef struct job_pool_t
+{
+  pthread_t* threads;
+  int num_threads; // workers, not counting threads that submit jobs
+
+  // Deque 0 is shared by threads outside the pool, worker i owns i + 1
+  job_deque_t* deques;
+  int num_deques;
+
+  // Idle workers sleep until something is queued
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;
+  int queued;
+  int sleeping;
+  bool quit;
+} job_pool_t;
+
+// One thread per core counting the caller, or POLYDRAW_THREADS if set
+int job_default_threads(void);
+
+// num_threads counts the calling thread, so 1 creates no workers
+void create_job_pool(job_pool_t* pool, int num_threads);
+
+void delete_job_pool(job_pool_t* pool);
+
+// Queues func(data, i) for every i in [0, count). The range starts once
+// after reaches zero, and done is decremented as its jobs finish. Either
+// counter may be NULL. A NULL pool runs the range like a single thread.
+void job_run(job_pool_t* pool, int count, job_func_t func, void* data,
+             job_counter_t* after, job_counter_t* done);
+
+// Runs queued jobs until counter reaches zero
+void job_wait(job_pool_t* pool, job_counter_t* counter);
+
+// job_run() followed by job_wait(). Indices are handed out in no
+// particular order, except on a single thread.
+void job_parallel_for(job_pool_t* pool, int count, job_func_t func, void* data);
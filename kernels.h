@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "geom.h"
+
+// Inner loops of draw.c and the point transform. A set is built for each
+// instruction set with its own compiler flags, and cpu.c picks one at run
+// time. Every set gives the same results as the scalar one, bit for bit.
+
+typedef struct
+{
+  // n copies of color
+  void (*fill)(uint32_t* dst, uint32_t color, size_t n);
+
+  // fill() with non-temporal stores, for buffers too big to stay in cache
+  void (*stream)(uint32_t* dst, uint32_t color, size_t n);
+
+  // dst = (add + dst * mul) >> 8 for each byte, the sum saturating at 16
+  // bits. add and mul hold four 16 bit factors, one per pixel channel.
+  void (*blend)(uint8_t* dst, size_t n, uint64_t add, uint64_t mul);
+
+  // x = (m[0] * x + m[1] * y) + m[2], y = (m[3] * x + m[4] * y) + m[5]
+  void (*transform)(point_t* points, size_t n, const float* m);
+
+  // Coverage of an 8x8 block by n half-planes: bit (y * 8) + x is set
+  // where e[i] + (x * dx[i]) + (y * dy[i]) >= 0 for every i. The sums
+  // must fit in 32 bits.
+  uint64_t (*block_mask)(const int32_t* e, const int32_t* dx, const int32_t* dy, int n);
+} kernels_t;
+
+void kernels_scalar(kernels_t* kernels);
+void kernels_sse2(kernels_t* kernels);
+void kernels_avx2(kernels_t* kernels);
+void kernels_avx512(kernels_t* kernels);
+
+// One pixel of the blend kernel, shared by the scalar tails
+static inline void blend_pixel_scalar(uint8_t* dst, uint64_t add, uint64_t mul)
+{
+  for (int c = 0; c < 4; c++)
+  {
+    uint32_t t = ((add >> (16 * c)) & 0xffff) + (dst[c] * ((mul >> (16 * c)) & 0xffff));
+    dst[c] = (t > 0xffff ? 0xffff : t) >> 8;
+  }
+}
+
+static inline void transform_point_scalar(point_t* p, const float* m)
+{
+  float x = p->x;
+  float y = p->y;
+  p->x = ((m[0] * x) + (m[1] * y)) + m[2];
+  p->y = ((m[3] * x) + (m[4] * y)) + m[5];
+}
@@ -0,0 +1,99 @@
+#include <immintrin.h>
+
+#include "kernels.h"
+
+static void fill_avx2(uint32_t* dst, uint32_t color, size_t n)
+{
+  __m256i v = _mm256_set1_epi32((int) color);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_si256((__m256i*) (dst + i), v);
+  for (; i < n; i++)
+    dst[i] = color;
+}
+
+static void stream_avx2(uint32_t* dst, uint32_t color, size_t n)
+{
+  size_t i = 0;
+  for (; i < n && ((uintptr_t) (dst + i) & 31); i++)
+    dst[i] = color;
+
+  __m256i v = _mm256_set1_epi32((int) color);
+  for (; i + 8 <= n; i += 8)
+    _mm256_stream_si256((__m256i*) (dst + i), v);
+  _mm_sfence();
+
+  for (; i < n; i++)
+    dst[i] = color;
+}
+
+// Unpacking and packing work within each 128 bit lane, so the pixel order
+// comes back out unchanged
+static void blend_avx2(uint8_t* dst, size_t n, uint64_t add, uint64_t mul)
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i a = _mm256_set1_epi64x((long long) add);
+  __m256i m = _mm256_set1_epi64x((long long) mul);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i d = _mm256_loadu_si256((const __m256i*) (dst + (i * 4)));
+    __m256i lo = _mm256_unpacklo_epi8(d, zero);
+    __m256i hi = _mm256_unpackhi_epi8(d, zero);
+    lo = _mm256_srli_epi16(_mm256_adds_epu16(a, _mm256_mullo_epi16(lo, m)), 8);
+    hi = _mm256_srli_epi16(_mm256_adds_epu16(a, _mm256_mullo_epi16(hi, m)), 8);
+    _mm256_storeu_si256((__m256i*) (dst + (i * 4)), _mm256_packus_epi16(lo, hi));
+  }
+
+  for (; i < n; i++)
+    blend_pixel_scalar(dst + (i * 4), add, mul);
+}
+
+static void transform_avx2(point_t* points, size_t n, const float* m)
+{
+  __m256 mx = _mm256_setr_ps(m[0], m[3], m[0], m[3], m[0], m[3], m[0], m[3]);
+  __m256 my = _mm256_setr_ps(m[1], m[4], m[1], m[4], m[1], m[4], m[1], m[4]);
+  __m256 t = _mm256_setr_ps(m[2], m[5], m[2], m[5], m[2], m[5], m[2], m[5]);
+  float* p = (float*) points;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256 v = _mm256_loadu_ps(p + (i * 2));
+    __m256 x = _mm256_moveldup_ps(v);
+    __m256 y = _mm256_movehdup_ps(v);
+    v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, mx), _mm256_mul_ps(y, my)), t);
+    _mm256_storeu_ps(p + (i * 2), v);
+  }
+
+  for (; i < n; i++)
+    transform_point_scalar(points + i, m);
+}
+
+// One vector per row. The sign bits mark the pixels outside.
+static uint64_t block_mask_avx2(const int32_t* e, const int32_t* dx, const int32_t* dy, int n)
+{
+  __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  uint64_t mask = ~(uint64_t) 0;
+  for (int i = 0; i < n; i++)
+  {
+    __m256i v = _mm256_add_epi32(_mm256_set1_epi32(e[i]), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(dx[i])));
+    __m256i step = _mm256_set1_epi32(dy[i]);
+    uint64_t outside = 0;
+    for (int y = 0; y < 8; y++)
+    {
+      outside |= (uint64_t) _mm256_movemask_ps(_mm256_castsi256_ps(v)) << (y * 8);
+      v = _mm256_add_epi32(v, step);
+    }
+    mask &= ~outside;
+  }
+  return mask;
+}
+
+void kernels_avx2(kernels_t* kernels)
+{
+  kernels->fill = fill_avx2;
+  kernels->stream = stream_avx2;
+  kernels->blend = blend_avx2;
+  kernels->transform = transform_avx2;
+  kernels->block_mask = block_mask_avx2;
+}
@@ -0,0 +1,103 @@
+#include <immintrin.h>
+
+#include "kernels.h"
+
+// AVX-512F with the byte and word instructions of AVX-512BW
+
+static void fill_avx512(uint32_t* dst, uint32_t color, size_t n)
+{
+  __m512i v = _mm512_set1_epi32((int) color);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_si512((void*) (dst + i), v);
+  for (; i < n; i++)
+    dst[i] = color;
+}
+
+static void stream_avx512(uint32_t* dst, uint32_t color, size_t n)
+{
+  size_t i = 0;
+  for (; i < n && ((uintptr_t) (dst + i) & 63); i++)
+    dst[i] = color;
+
+  __m512i v = _mm512_set1_epi32((int) color);
+  for (; i + 16 <= n; i += 16)
+    _mm512_stream_si512((void*) (dst + i), v);
+  _mm_sfence();
+
+  for (; i < n; i++)
+    dst[i] = color;
+}
+
+static void blend_avx512(uint8_t* dst, size_t n, uint64_t add, uint64_t mul)
+{
+  __m512i zero = _mm512_setzero_si512();
+  __m512i a = _mm512_set1_epi64((long long) add);
+  __m512i m = _mm512_set1_epi64((long long) mul);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m512i d = _mm512_loadu_si512((const void*) (dst + (i * 4)));
+    __m512i lo = _mm512_unpacklo_epi8(d, zero);
+    __m512i hi = _mm512_unpackhi_epi8(d, zero);
+    lo = _mm512_srli_epi16(_mm512_adds_epu16(a, _mm512_mullo_epi16(lo, m)), 8);
+    hi = _mm512_srli_epi16(_mm512_adds_epu16(a, _mm512_mullo_epi16(hi, m)), 8);
+    _mm512_storeu_si512((void*) (dst + (i * 4)), _mm512_packus_epi16(lo, hi));
+  }
+
+  for (; i < n; i++)
+    blend_pixel_scalar(dst + (i * 4), add, mul);
+}
+
+static void transform_avx512(point_t* points, size_t n, const float* m)
+{
+  __m512 mx = _mm512_setr4_ps(m[0], m[3], m[0], m[3]);
+  __m512 my = _mm512_setr4_ps(m[1], m[4], m[1], m[4]);
+  __m512 t = _mm512_setr4_ps(m[2], m[5], m[2], m[5]);
+  float* p = (float*) points;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m512 v = _mm512_loadu_ps(p + (i * 2));
+    __m512 x = _mm512_moveldup_ps(v);
+    __m512 y = _mm512_movehdup_ps(v);
+    v = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, mx), _mm512_mul_ps(y, my)), t);
+    _mm512_storeu_ps(p + (i * 2), v);
+  }
+
+  for (; i < n; i++)
+    transform_point_scalar(points + i, m);
+}
+
+// Two rows per vector, compared straight into a mask register
+static uint64_t block_mask_avx512(const int32_t* e, const int32_t* dx, const int32_t* dy, int n)
+{
+  __m512i xs = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7);
+  __m512i ys = _mm512_setr_epi32(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+  __m512i zero = _mm512_setzero_si512();
+  uint64_t mask = ~(uint64_t) 0;
+  for (int i = 0; i < n; i++)
+  {
+    __m512i v = _mm512_add_epi32(_mm512_set1_epi32(e[i]),
+                                 _mm512_add_epi32(_mm512_mullo_epi32(xs, _mm512_set1_epi32(dx[i])),
+                                                  _mm512_mullo_epi32(ys, _mm512_set1_epi32(dy[i]))));
+    __m512i step = _mm512_set1_epi32(2 * dy[i]);
+    uint64_t inside = 0;
+    for (int y = 0; y < 8; y += 2)
+    {
+      inside |= (uint64_t) _mm512_cmpge_epi32_mask(v, zero) << (y * 8);
+      v = _mm512_add_epi32(v, step);
+    }
+    mask &= inside;
+  }
+  return mask;
+}
+
+void kernels_avx512(kernels_t* kernels)
+{
+  kernels->fill = fill_avx512;
+  kernels->stream = stream_avx512;
+  kernels->blend = blend_avx512;
+  kernels->transform = transform_avx512;
+  kernels->block_mask = block_mask_avx512;
+}
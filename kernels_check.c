@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernels_check.h"
+#include "cpu.h"
+
+#define CHECK_MAX_N 80
+#define CHECK_RUNS 2000
+
+static uint32_t check_rand(void)
+{
+  return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+// Runs one kernel of both sets on the same random input at every length
+// and offset, comparing the whole buffer so stray writes show up too
+static bool check_kernel_set(const kernels_t* ref, const kernels_t* k)
+{
+  uint32_t a[CHECK_MAX_N + 20], b[CHECK_MAX_N + 20];
+  point_t pa[CHECK_MAX_N + 4], pb[CHECK_MAX_N + 4];
+  
+  for (int run = 0; run < CHECK_RUNS; run++)
+  {
+    size_t n = run % CHECK_MAX_N;
+    size_t offset = (run / CHECK_MAX_N) % 16;
+    uint32_t color = check_rand();
+    for (int i = 0; i < CHECK_MAX_N + 20; i++)
+      a[i] = b[i] = check_rand();
+
+    ref->fill(a + offset, color, n);
+    k->fill(b + offset, color, n);
+    if (memcmp(a, b, sizeof(a)))
+      return false;
+
+    ref->stream(a + offset, ~color, n);
+    k->stream(b + offset, ~color, n);
+    if (memcmp(a, b, sizeof(a)))
+      return false;
+
+    uint64_t add = 0, mul = 0;
+    for (int c = 0; c < 4; c++)
+    {
+      add |= (uint64_t) (check_rand() & 0xffff) << (16 * c);
+      mul |= (uint64_t) (check_rand() % 257) << (16 * c);
+    }
+    for (int i = 0; i < CHECK_MAX_N + 20; i++)
+      a[i] = b[i] = check_rand();
+    ref->blend((uint8_t*) (a + offset), n, add, mul);
+    k->blend((uint8_t*) (b + offset), n, add, mul);
+    if (memcmp(a, b, sizeof(a)))
+      return false;
+
+    float m[6];
+    for (int i = 0; i < 6; i++)
+      m[i] = ((float) rand() / RAND_MAX - 0.5f) * 4;
+    for (int i = 0; i < CHECK_MAX_N + 4; i++)
+    {
+      pa[i].x = pb[i].x = ((float) rand() / RAND_MAX) * 4000 - 2000;
+      pa[i].y = pb[i].y = ((float) rand() / RAND_MAX) * 4000 - 2000;
+    }
+    ref->transform(pa + (offset % 4), n, m);
+    k->transform(pb + (offset % 4), n, m);
+    if (memcmp(pa, pb, sizeof(pa)))
+      return false;
+
+    // Edges through the block, as the triangle fill passes them
+    int32_t e[3], dx[3], dy[3];
+    for (int i = 0; i < 3; i++)
+    {
+      dx[i] = (int32_t) (check_rand() % 20001) - 10000;
+      dy[i] = (int32_t) (check_rand() % 20001) - 10000;
+      e[i] = (int32_t) (check_rand() % 140001) - 70000;
+    }
+    int num_edges = 1 + (run % 3);
+    if (ref->block_mask(e, dx, dy, num_edges) != k->block_mask(e, dx, dy, num_edges))
+      return false;
+  }
+  return true;
+}
+
+int check_kernels(void)
+{
+  kernels_t ref;
+  simd_kernels(SIMD_SCALAR, &ref);
+
+  int failed = 0;
+  for (int level = SIMD_SSE2; level <= SIMD_AVX512; level++)
+  {
+    kernels_t k;
+    if (!simd_kernels(level, &k))
+    {
+      printf("%-8s skipped, not supported\n", simd_level_name(level));
+      continue;
+    }
+
+    bool ok = check_kernel_set(&ref, &k);
+    printf("%-8s %s\n", simd_level_name(level), ok ? "ok" : "FAILED");
+    if (!ok)
+      failed++;
+  }
+  return failed;
+}
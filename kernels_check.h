@@ -0,0 +1,7 @@
+#pragma once
+
+// Runs the kernels of every SIMD level the CPU supports on random input
+// and compares them with the scalar ones, printing a line per level.
+// Returns the number of levels that differ. Seed rand() first for
+// repeatable runs. Shared by polydraw_bench --check and ctest.
+int check_kernels(void);
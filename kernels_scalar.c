@@ -0,0 +1,47 @@
+#include "kernels.h"
+
+static void fill_scalar(uint32_t* dst, uint32_t color, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    dst[i] = color;
+}
+
+static void blend_scalar(uint8_t* dst, size_t n, uint64_t add, uint64_t mul)
+{
+  for (size_t i = 0; i < n; i++)
+    blend_pixel_scalar(dst + (i * 4), add, mul);
+}
+
+static void transform_scalar(point_t* points, size_t n, const float* m)
+{
+  for (size_t i = 0; i < n; i++)
+    transform_point_scalar(points + i, m);
+}
+
+static uint64_t block_mask_scalar(const int32_t* e, const int32_t* dx, const int32_t* dy, int n)
+{
+  uint64_t mask = ~(uint64_t) 0;
+  for (int i = 0; i < n; i++)
+  {
+    uint64_t m = 0;
+    for (int y = 0; y < 8; y++)
+    {
+      for (int x = 0; x < 8; x++)
+      {
+        if (e[i] + (x * dx[i]) + (y * dy[i]) >= 0)
+          m |= (uint64_t) 1 << ((y * 8) + x);
+      }
+    }
+    mask &= m;
+  }
+  return mask;
+}
+
+void kernels_scalar(kernels_t* kernels)
+{
+  kernels->fill = fill_scalar;
+  kernels->stream = fill_scalar;
+  kernels->blend = blend_scalar;
+  kernels->transform = transform_scalar;
+  kernels->block_mask = block_mask_scalar;
+}
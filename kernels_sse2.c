@@ -0,0 +1,103 @@
+#include <immintrin.h>
+
+#include "kernels.h"
+
+static void fill_sse2(uint32_t* dst, uint32_t color, size_t n)
+{
+  __m128i v = _mm_set1_epi32((int) color);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_si128((__m128i*) (dst + i), v);
+  for (; i < n; i++)
+    dst[i] = color;
+}
+
+static void stream_sse2(uint32_t* dst, uint32_t color, size_t n)
+{
+  size_t i = 0;
+
+  // Streaming stores need aligned addresses
+  for (; i < n && ((uintptr_t) (dst + i) & 15); i++)
+    dst[i] = color;
+
+  __m128i v = _mm_set1_epi32((int) color);
+  for (; i + 4 <= n; i += 4)
+    _mm_stream_si128((__m128i*) (dst + i), v);
+  _mm_sfence();
+
+  for (; i < n; i++)
+    dst[i] = color;
+}
+
+// Pixels are widened to 16 bits, two at a time in each half
+static void blend_sse2(uint8_t* dst, size_t n, uint64_t add, uint64_t mul)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i a = _mm_set1_epi64x((long long) add);
+  __m128i m = _mm_set1_epi64x((long long) mul);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i d = _mm_loadu_si128((const __m128i*) (dst + (i * 4)));
+    __m128i lo = _mm_unpacklo_epi8(d, zero);
+    __m128i hi = _mm_unpackhi_epi8(d, zero);
+    lo = _mm_srli_epi16(_mm_adds_epu16(a, _mm_mullo_epi16(lo, m)), 8);
+    hi = _mm_srli_epi16(_mm_adds_epu16(a, _mm_mullo_epi16(hi, m)), 8);
+    _mm_storeu_si128((__m128i*) (dst + (i * 4)), _mm_packus_epi16(lo, hi));
+  }
+
+  for (; i < n; i++)
+    blend_pixel_scalar(dst + (i * 4), add, mul);
+}
+
+// Two points per vector, x and y spread over both lanes of each point
+static void transform_sse2(point_t* points, size_t n, const float* m)
+{
+  __m128 mx = _mm_setr_ps(m[0], m[3], m[0], m[3]);
+  __m128 my = _mm_setr_ps(m[1], m[4], m[1], m[4]);
+  __m128 t = _mm_setr_ps(m[2], m[5], m[2], m[5]);
+  float* p = (float*) points;
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    __m128 v = _mm_loadu_ps(p + (i * 2));
+    __m128 x = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128 y = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1));
+    v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, mx), _mm_mul_ps(y, my)), t);
+    _mm_storeu_ps(p + (i * 2), v);
+  }
+
+  for (; i < n; i++)
+    transform_point_scalar(points + i, m);
+}
+
+// Two vectors per row. The sign bits mark the pixels outside.
+static uint64_t block_mask_sse2(const int32_t* e, const int32_t* dx, const int32_t* dy, int n)
+{
+  uint64_t mask = ~(uint64_t) 0;
+  for (int i = 0; i < n; i++)
+  {
+    __m128i lo = _mm_setr_epi32(e[i], e[i] + dx[i], e[i] + (2 * dx[i]), e[i] + (3 * dx[i]));
+    __m128i hi = _mm_add_epi32(lo, _mm_set1_epi32(4 * dx[i]));
+    __m128i step = _mm_set1_epi32(dy[i]);
+    uint64_t outside = 0;
+    for (int y = 0; y < 8; y++)
+    {
+      int row = _mm_movemask_ps(_mm_castsi128_ps(lo)) | (_mm_movemask_ps(_mm_castsi128_ps(hi)) << 4);
+      outside |= (uint64_t) row << (y * 8);
+      lo = _mm_add_epi32(lo, step);
+      hi = _mm_add_epi32(hi, step);
+    }
+    mask &= ~outside;
+  }
+  return mask;
+}
+
+void kernels_sse2(kernels_t* kernels)
+{
+  kernels->fill = fill_sse2;
+  kernels->stream = stream_sse2;
+  kernels->blend = blend_sse2;
+  kernels->transform = transform_sse2;
+  kernels->block_mask = block_mask_sse2;
+}
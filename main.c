@@ -14,6 +14,9 @@
 #include "draw.h"
 #include "geom.h"
 #include "transform.h"
+#include "spatial_hash.h"
+#include "job.h"
+#include "raster.h"
 
 #define WIDTH 800
 #define HEIGHT 600
@@ -23,10 +26,23 @@ static void error_callback(int error, const char *description)
   fprintf(stderr, description);
 }
 
+static bool g_antialias = false;
+static fill_rule_t g_fill_rule = FILL_EVEN_ODD;
+static bool g_translucent = false;
+static bool g_triangles = false;
+
 static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
 {
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
     glfwSetWindowShouldClose(window, GL_TRUE);
+  if (key == GLFW_KEY_Q && action == GLFW_PRESS)
+    g_antialias = !g_antialias;
+  if (key == GLFW_KEY_N && action == GLFW_PRESS)
+    g_fill_rule = g_fill_rule == FILL_NON_ZERO ? FILL_EVEN_ODD : FILL_NON_ZERO;
+  if (key == GLFW_KEY_B && action == GLFW_PRESS)
+    g_translucent = !g_translucent;
+  if (key == GLFW_KEY_T && action == GLFW_PRESS)
+    g_triangles = !g_triangles;
 }
 
 enum mode_t
@@ -52,7 +68,7 @@ void ui_init(ui_t* ui)
   
   ui->header = gltCreateText();
   gltSetText(ui->header,
-             "Press 1-4 for different modes:\n"
+             "Press 1-4 for different modes. Q: Antialiasing, N: Fill rule, B: Translucent, T: Triangles\n"
              "1: DRAW, 2: DEFORM, 3: TRANSFORM, 4: MORPH, R: Reset");
   ui->instructions = gltCreateText();
   ui->warning = gltCreateText();
@@ -125,6 +141,180 @@ void ui_destroy(ui_t* ui)
 static int g_last_mouse_l_state = GLFW_RELEASE;
 static int g_last_mouse_r_state = GLFW_RELEASE;
 
+// Index over every polygon vertex, for picking
+#define PICK_CELL_SIZE 16
+static spatial_hash_t g_vertex_index;
+
+// Shared by the repaint and the per-polygon work of the modes
+static job_pool_t g_jobs;
+
+// Indexes the most recently added point of a polygon
+static void index_last_point(polygon_t** polygons, polygon_t* p)
+{
+  vertex_ref_t ref = {.poly = p - *polygons, .point = p->num_points - 1};
+  spatial_hash_insert(&g_vertex_index, ref, p->points[ref.point]);
+}
+
+// Repaint tracking
+//
+// The pixel buffer persists between frames, so only regions that changed
+// are cleared and redrawn: where the polygons that were edited used to be
+// and are now, and wherever the mode overlays were drawn last frame.
+
+#define REPAINT_MARGIN 2
+
+typedef struct
+{
+  unsigned int version;
+  rect_t rect;
+} drawn_polygon_t;
+
+static rect_t polygon_rect(polygon_t* p)
+{
+  rect_t r = {0, 0, 0, 0};
+  if (!p->num_points)
+    return r;
+  
+  aabb_t b = polygon_bounds(p);
+  r.x0 = floorf(b.min.x) - REPAINT_MARGIN;
+  r.y0 = floorf(b.min.y) - REPAINT_MARGIN;
+  r.x1 = floorf(b.max.x) + 1 + REPAINT_MARGIN;
+  r.y1 = floorf(b.max.y) + 1 + REPAINT_MARGIN;
+  return r;
+}
+
+// Adds the regions of polygons that changed since they were last drawn,
+// returning the index of the first one that did
+static int damage_changed_polygons(rect_list_t* repaint, drawn_polygon_t** drawn,
+                                   polygon_t* polygons)
+{
+  int first = sb_count(polygons);
+  for (int i = 0; i < sb_count(polygons); i++)
+  {
+    if (i >= sb_count(*drawn))
+    {
+      drawn_polygon_t d = {.version = 0, .rect = {0, 0, 0, 0}};
+      sb_push(*drawn, d);
+    }
+
+    drawn_polygon_t* d = *drawn + i;
+    polygon_t* p = polygons + i;
+    if (d->version == p->version)
+      continue;
+
+    rect_list_add(repaint, d->rect);
+    d->rect = polygon_rect(p);
+    d->version = p->version;
+    rect_list_add(repaint, d->rect);
+    if (i < first)
+      first = i;
+  }
+  return first;
+}
+
+typedef struct
+{
+  pixel_t bg_color;
+  pixel_t poly_color;
+  pixel_t line_color;
+  fill_rule_t fill_rule;
+  bool translucent;
+  bool triangles;
+} polygon_style_t;
+
+// Records the fills and outlines of polygons [first, last) that overlap a
+// region, in order
+static void record_polygons(raster_t* raster, const pixel_display_t* display, const polygon_style_t* style,
+                            polygon_t* polygons, drawn_polygon_t* drawn, int first, int last, rect_t region)
+{
+  // Overlapping translucent polygons show through each other
+  raster_set_blend(raster, style->translucent ? BLEND_OVER : BLEND_REPLACE);
+  
+  for (int i = first; i < last; i++)
+  {
+    polygon_t* p = polygons + i;
+    if (!rect_overlap(drawn[i].rect, region))
+      continue;
+    
+    if (display->quality == QUALITY_ANTIALIASED)
+      raster_fill_aa(raster, style->poly_color, p, style->fill_rule);
+    else if (style->triangles)
+      raster_fill_triangles(raster, style->poly_color, p, style->fill_rule);
+    else
+      raster_fill(raster, style->poly_color, p, style->fill_rule);
+    raster_bounds(raster, style->line_color, p);
+  }
+}
+
+// Static layer
+//
+// The background and the polygons below the first one being edited are
+// kept drawn in a layer of their own. Repainting a region copies it from
+// the layer and only draws the polygons from the edited one up, so
+// dragging a vertex does not refill everything under it, while the
+// polygons above still cover it. The layer is redrawn when one of its
+// polygons changes or the style does, and takes the edited polygons back
+// once they have been left alone for LAYER_SETTLE_FRAMES.
+
+#define LAYER_SETTLE_FRAMES 30
+
+typedef struct
+{
+  pixel_display_t display;
+  int num_polys; // polygons [0, num_polys) are drawn into it
+  bool valid;
+  int settled;   // frames in a row without a polygon changing
+} static_layer_t;
+
+static void create_static_layer(static_layer_t* layer, size_t w, size_t h)
+{
+  create_mem_pixel_display(&layer->display, w, h);
+  layer->num_polys = 0;
+  layer->valid = false;
+  layer->settled = 0;
+}
+
+static void delete_static_layer(static_layer_t* layer)
+{
+  delete_pixel_display(&layer->display);
+}
+
+// changed is the first polygon that changed this frame
+static void update_static_layer(static_layer_t* layer, raster_t* raster, draw_quality_t quality,
+                                const polygon_style_t* style, polygon_t* polygons,
+                                drawn_polygon_t* drawn, int changed)
+{
+  int count = sb_count(polygons);
+  if (changed < count)
+    layer->settled = 0;
+  else if (layer->settled < LAYER_SETTLE_FRAMES)
+    layer->settled++;
+
+  int num_polys = layer->num_polys;
+  if (changed < num_polys)
+    num_polys = changed;
+  else if (layer->settled >= LAYER_SETTLE_FRAMES)
+    num_polys = count;
+  if (num_polys > count)
+    num_polys = count;
+  if (layer->valid && num_polys == layer->num_polys)
+    return;
+
+  pixel_display_t* display = &layer->display;
+  display->quality = quality;
+  pixel_display_fill_start(display);
+  
+  rect_t all = {0, 0, display->w, display->h};
+  raster_set_blend(raster, BLEND_REPLACE);
+  raster_clear(raster, style->bg_color);
+  record_polygons(raster, display, style, polygons, drawn, 0, num_polys, all);
+  raster_flush(raster, display);
+  
+  pixel_display_fill_end(display);
+  layer->num_polys = num_polys;
+  layer->valid = true;
+}
+
 void draw_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, polygon_t** polygons)
 {
   static pixel_t line_color = {.r = 255, .g = 0, .b = 0, .a = 255};
@@ -162,6 +352,7 @@ void draw_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, polygon_t
   if (state == GLFW_PRESS && g_last_mouse_l_state != GLFW_PRESS)
   {
     polygon_add_point(current_polygon, new_point); // new point
+    index_last_point(polygons, current_polygon);
   }
   g_last_mouse_l_state = state;
   state = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT);
@@ -170,6 +361,7 @@ void draw_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, polygon_t
     if (current_polygon->points && current_polygon->num_points >= 2)
     {
       polygon_close(current_polygon, new_point);
+      index_last_point(polygons, current_polygon);
           
       polygon_t new_polygon;
       create_polygon(&new_polygon);
@@ -179,37 +371,22 @@ void draw_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, polygon_t
   g_last_mouse_r_state = state;
 }
 
-point_t* closest_point(int x, int y, polygon_t** polygons, double min_d)
+point_t* closest_point(int x, int y, polygon_t** polygons, double min_d, polygon_t** owner)
 {
-  int d = 0;
-  point_t* closest_point = NULL;
-  for (int i = 0; i < sb_count(*polygons); i++)
-  {
-    polygon_t* p = *polygons + i;
-    for (int j = 0; j < sb_count(p->points); j++)
-    {
-      point_t* point = p->points + j;
-
-      double dx = (double) abs(x - point->x);
-      double dy = (double) abs(y - point->y);
-      double new_d = sqrt(dx * dx + dy * dy);
-      if (!closest_point
-          || new_d < d)
-      {
-        closest_point = point;
-        d = new_d;
-      }
-    }
-  }
-  if (d > min_d)
+  point_t pos = {.x = x, .y = y};
+  vertex_ref_t ref;
+  if (!spatial_hash_nearest(&g_vertex_index, pos, min_d, -1, &ref))
     return NULL;
-  return closest_point;
+
+  *owner = *polygons + ref.poly;
+  return (*owner)->points + ref.point;
 }
 
 void deform_mode(pixel_display_t* display, GLFWwindow* window, polygon_t** polygons)
 {
   static pixel_t point_color = {.r = 255, .g = 0, .b = 0, .a = 255};
   static point_t* dragged_point = NULL;
+  static polygon_t* dragged_poly = NULL;
   
   if (!*polygons)
     return;
@@ -220,15 +397,21 @@ void deform_mode(pixel_display_t* display, GLFWwindow* window, polygon_t** polyg
   int state = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
 
   if (state == GLFW_RELEASE)
-    dragged_point = closest_point((int) x, (int) y, polygons, 10);
+    dragged_point = closest_point((int) x, (int) y, polygons, 10, &dragged_poly);
 
   if (!dragged_point)
     return;
   
-  if (state == GLFW_PRESS)
+  if (state == GLFW_PRESS
+      && (dragged_point->x != (int) x || dragged_point->y != (int) y))
   {
     dragged_point->x = (int) x;
     dragged_point->y = (int) y;
+    polygon_touch(dragged_poly);
+
+    vertex_ref_t ref = {.poly = dragged_poly - *polygons,
+                        .point = dragged_point - dragged_poly->points};
+    spatial_hash_move(&g_vertex_index, ref, *dragged_point);
   }
 
   draw_point(display, point_color, dragged_point->x, dragged_point->y, 5); 
@@ -236,31 +419,11 @@ void deform_mode(pixel_display_t* display, GLFWwindow* window, polygon_t** polyg
 
 polygon_t* closest_polygon(int x, int y, polygon_t** polygons, double min_d)
 {
-  int d = 0;
-  polygon_t* closest_p = NULL;
-  for (int i = 0; i < sb_count(*polygons); i++)
-  {
-    polygon_t* p = *polygons + i;
-    for (int j = 0; j < sb_count(p->points); j++)
-    {
-      point_t* point = p->points + j;
-
-      double dx = (double) abs(x - point->x);
-      double dy = (double) abs(y - point->y);
-      double new_d = sqrt(dx * dx + dy * dy);
-      
-      if (!closest_p
-          || new_d < d)
-      {
-        closest_p = p;
-        d = new_d;
-      }
-    }
-  }
-  
-  if (d > min_d)
+  point_t pos = {.x = x, .y = y};
+  vertex_ref_t ref;
+  if (!spatial_hash_nearest(&g_vertex_index, pos, min_d, -1, &ref))
     return NULL;
-  return closest_p;
+  return *polygons + ref.poly;
 }
   
 static pixel_t red   = {.r = 255, .g = 0, .b = 0, .a = 255};
@@ -270,6 +433,36 @@ static pixel_t green = {.r = 0, .g = 255, .b = 0, .a = 255};
 static int last_l_mouse_state = GLFW_RELEASE;
 static int last_r_mouse_state = GLFW_RELEASE;
 
+// Points are transformed in blocks, one job per block
+#define TRANSFORM_BLOCK 1024
+
+typedef struct
+{
+  polygon_t* polygon;
+  const mat3_t* mat;
+  point_t origin;
+} transform_job_t;
+
+static void transform_block(void* data, int block)
+{
+  transform_job_t* job = (transform_job_t*) data;
+  polygon_t* polygon = job->polygon;
+  int first = block * TRANSFORM_BLOCK;
+  int end = first + TRANSFORM_BLOCK;
+  if (end > polygon->num_points)
+    end = polygon->num_points;
+  
+  mat3_transform_points(job->mat, job->origin, polygon->points + first, end - first);
+}
+
+static void transform_polygon(polygon_t* polygon, const mat3_t* mat, point_t origin)
+{
+  transform_job_t job = {.polygon = polygon, .mat = mat, .origin = origin};
+  int blocks = (polygon->num_points + TRANSFORM_BLOCK - 1) / TRANSFORM_BLOCK;
+  job_parallel_for(&g_jobs, blocks, transform_block, &job);
+  polygon_touch(polygon);
+}
+
 void transform_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, polygon_t** polygons)
 {  
   typedef enum
@@ -488,19 +681,8 @@ void transform_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, poly
       // Commit transformation
       if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS)
       {
-        // Transform polygon
-        for (int i = 0; i < polygon->num_points; i++)
-        {
-          vec3_t pos;
-          pos.vals[0] = polygon->points[i].x - origin.x;
-          pos.vals[1] = polygon->points[i].y - origin.y;
-          pos.vals[2] = 1;
-          
-          pos = mat3_vec3_mult(&transform_mat, &pos);
-
-          polygon->points[i].x = pos.vals[0] + origin.x;
-          polygon->points[i].y = pos.vals[1] + origin.y;
-        }
+        transform_polygon(polygon, &transform_mat, origin);
+        spatial_hash_update_polygon(&g_vertex_index, poly_index, polygon);
         mat3_identity(&transform_mat);
       }
     }
@@ -509,8 +691,7 @@ void transform_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, poly
     {
       polygon_t* closest_poly = closest_polygon((int) x, (int) y, polygons, 20);
       if (closest_poly
-          && closest_poly->closed
-          && !closest_poly->complex)
+          && closest_poly->closed)
       {
         draw_polygon_points(display, red, closest_poly, 5);
       
@@ -528,27 +709,13 @@ void transform_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, poly
   }
 }
 
-point_t* closest_point_in_poly(int x, int y, polygon_t* p, double min_d)
+point_t* closest_point_in_poly(int x, int y, polygon_t** polygons, polygon_t* p, double min_d)
 {
-  int d = 0;
-  point_t* closest_point = NULL;
-  for (int j = 0; j < sb_count(p->points); j++)
-  {
-    point_t* point = p->points + j;
-    
-    double dx = (double) abs(x - point->x);
-    double dy = (double) abs(y - point->y);
-    double new_d = sqrt(dx * dx + dy * dy);
-    if (!closest_point
-        || new_d < d)
-    {
-      closest_point = point;
-      d = new_d;
-    }
-  }
-  if (d > min_d)
+  point_t pos = {.x = x, .y = y};
+  vertex_ref_t ref;
+  if (!spatial_hash_nearest(&g_vertex_index, pos, min_d, p - *polygons, &ref))
     return NULL;
-  return closest_point;
+  return p->points + ref.point;
 }
 
 void morph_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, polygon_t** polygons)
@@ -602,6 +769,8 @@ void morph_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, polygon_
         n++;
       }
     }
+    polygon_touch(p);
+    spatial_hash_update_polygon(&g_vertex_index, poly_index, p);
 
     if (n == p->num_points)
     {
@@ -630,8 +799,7 @@ void morph_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, polygon_
       polygon_t* closest_poly = closest_polygon((int) x, (int) y, polygons, 20);
       
       if (closest_poly
-          && closest_poly->closed
-          && !closest_poly->complex)
+          && closest_poly->closed)
       {
         draw_polygon_points(display, red, closest_poly, 5);
       
@@ -641,7 +809,7 @@ void morph_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, polygon_
           poly_index = (closest_poly - *polygons);
         }
       
-        point_t* point = closest_point_in_poly(x, y, closest_poly, 20);
+        point_t* point = closest_point_in_poly(x, y, polygons, closest_poly, 20);
         point_index = point - closest_poly->points;
         points = malloc(sizeof(point_t) * closest_poly->num_points);
         
@@ -661,7 +829,7 @@ void morph_mode(pixel_display_t* display, ui_t* ui, GLFWwindow* window, polygon_
       else
       {
         polygon_t* p = *polygons + poly_index;
-        point_t* point = closest_point_in_poly(x, y, p, 20);
+        point_t* point = closest_point_in_poly(x, y, polygons, p, 20);
         if (point)
         {
           point_index = point - p->points;
@@ -790,7 +958,7 @@ int main(void) {
   //
   
   pixel_display_t display;
-  create_pixel_display(&display, WIDTH, HEIGHT);
+  create_gl_pixel_display(&display, WIDTH, HEIGHT);
 
   pixel_t bg_color;
   bg_color.r = 200;
@@ -802,7 +970,7 @@ int main(void) {
   line_color.r = 0;
   line_color.g = 0;
   line_color.b = 0;
-  line_color.a = 0;
+  line_color.a = 255;
 
   pixel_t poly_color;
   poly_color.r = 255;
@@ -819,6 +987,20 @@ int main(void) {
   ui_init(&ui);
 
   polygon_t* polygons = NULL;
+  create_spatial_hash(&g_vertex_index, PICK_CELL_SIZE);
+
+  create_job_pool(&g_jobs, job_default_threads());
+  raster_t raster;
+  create_raster(&raster, &g_jobs);
+  static_layer_t layer;
+  create_static_layer(&layer, display.w, display.h);
+
+  drawn_polygon_t* drawn = NULL;
+  rect_list_t overlay = {.count = 0};
+  bool full_repaint = true;
+  fill_rule_t fill_rule = g_fill_rule;
+  bool translucent = g_translucent;
+  bool triangles = g_triangles;
   
   while (!glfwWindowShouldClose(window))
   {
@@ -829,30 +1011,68 @@ int main(void) {
     glClear(GL_COLOR_BUFFER_BIT);
     
     pixel_display_fill_start(&display);
-    clear_display(&display, bg_color);
     
-    bool intersect_warn = false;
+    // Bring the caches of polygons that changed up to date
+    polygon_set_update_caches(polygons, sb_count(polygons), &g_jobs);
 
-    // Check intersections
+    // Complex polygons still fill, but keep warning about them. The test
+    // is cached, it only runs again for polygons that changed.
+    bool intersect_warn = false;
     for (int i = 0; i < sb_count(polygons); i++)
     {
-      polygon_t* p = polygons + i;
-      if (p->complex = poly_self_intersect(p))
+      if (polygon_is_complex(polygons + i))
         intersect_warn = true;
     }
 
     if (intersect_warn)
       ui_warn_intersection(&ui);
 
-    // Draw scan fill polys
-    for (int i = 0; i < sb_count(polygons); i++)
+    draw_quality_t quality = g_antialias ? QUALITY_ANTIALIASED : QUALITY_ALIASED;
+    if (display.quality != quality)
+    {
+      display.quality = quality;
+      full_repaint = true;
+    }
+    if (fill_rule != g_fill_rule || translucent != g_translucent || triangles != g_triangles)
     {
-      polygon_t* p = polygons + i;
-      if (!p->complex)
-        scan_fill(&display, poly_color, p);
-      draw_polygon_bounds(&display, line_color, polygons + i);
+      fill_rule = g_fill_rule;
+      translucent = g_translucent;
+      triangles = g_triangles;
+      poly_color.a = translucent ? 160 : 255;
+      full_repaint = true;
     }
 
+    // Work out what needs to be redrawn
+    rect_list_t repaint = overlay;
+    if (full_repaint)
+    {
+      rect_t all = {0, 0, display.w, display.h};
+      rect_list_add(&repaint, all);
+      layer.valid = false;
+      full_repaint = false;
+    }
+    int changed = damage_changed_polygons(&repaint, &drawn, polygons);
+
+    polygon_style_t style = {.bg_color = bg_color, .poly_color = poly_color, .line_color = line_color,
+                             .fill_rule = fill_rule, .translucent = translucent, .triangles = triangles};
+    update_static_layer(&layer, &raster, display.quality, &style, polygons, drawn, changed);
+
+    // Copy each damaged region from the static layer, then draw the
+    // polygons above it clipped to the region
+    for (int r = 0; r < repaint.count; r++)
+    {
+      pixel_display_set_clip(&display, repaint.rects[r]);
+      copy_display(&display, &layer.display, repaint.rects[r]);
+      record_polygons(&raster, &display, &style, polygons, drawn,
+                      layer.num_polys, sb_count(polygons), repaint.rects[r]);
+      raster_flush(&raster, &display);
+    }
+    pixel_display_reset_clip(&display);
+
+    // Mode overlays are gone next frame, keep their damage separately
+    rect_list_t redrawn = display.dirty;
+    display.dirty.count = 0;
+
     // Modes
     // Get key
     if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
@@ -871,6 +1091,11 @@ int main(void) {
       }
       sb_free(polygons);
       polygons = NULL;
+      spatial_hash_clear(&g_vertex_index);
+
+      sb_free(drawn);
+      drawn = NULL;
+      full_repaint = true;
     }
     // Draw to pixel buffer
 
@@ -890,6 +1115,10 @@ int main(void) {
     {
       morph_mode(&display, &ui, window, &polygons);
     }
+
+    overlay = display.dirty;
+    for (int i = 0; i < redrawn.count; i++)
+      rect_list_add(&display.dirty, redrawn.rects[i]);
     
     pixel_display_fill_end(&display);
     
@@ -903,7 +1132,7 @@ int main(void) {
     set_vertex_spec(&vert_spec);
     
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, display.tex);
+    glBindTexture(GL_TEXTURE_2D, gl_pixel_display_texture(&display));
     
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
@@ -920,6 +1149,11 @@ int main(void) {
     delete_polygon(polygons + i);
   }
   sb_free(polygons);
+  sb_free(drawn);
+  delete_spatial_hash(&g_vertex_index);
+  delete_static_layer(&layer);
+  delete_raster(&raster);
+  delete_job_pool(&g_jobs);
   
   ui_destroy(&ui);
     
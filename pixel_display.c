@@ -0,0 +1,189 @@
+#include "pixel_display.h"
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+void* pixel_alloc(size_t size)
+{
+#if defined(_WIN32)
+  return _aligned_malloc(size, PIXEL_DISPLAY_ALIGNMENT);
+#else
+  void* ptr = NULL;
+  if (posix_memalign(&ptr, PIXEL_DISPLAY_ALIGNMENT, size))
+    return NULL;
+  return ptr;
+#endif
+}
+
+void pixel_free(void* ptr)
+{
+#if defined(_WIN32)
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+// Rects
+
+bool rect_is_empty(rect_t r)
+{
+  return r.x0 >= r.x1 || r.y0 >= r.y1;
+}
+
+bool rect_overlap(rect_t a, rect_t b)
+{
+  return !rect_is_empty(rect_intersect(a, b));
+}
+
+rect_t rect_intersect(rect_t a, rect_t b)
+{
+  rect_t r;
+  r.x0 = a.x0 > b.x0 ? a.x0 : b.x0;
+  r.y0 = a.y0 > b.y0 ? a.y0 : b.y0;
+  r.x1 = a.x1 < b.x1 ? a.x1 : b.x1;
+  r.y1 = a.y1 < b.y1 ? a.y1 : b.y1;
+  return r;
+}
+
+rect_t rect_union(rect_t a, rect_t b)
+{
+  if (rect_is_empty(a))
+    return b;
+  if (rect_is_empty(b))
+    return a;
+  
+  rect_t r;
+  r.x0 = a.x0 < b.x0 ? a.x0 : b.x0;
+  r.y0 = a.y0 < b.y0 ? a.y0 : b.y0;
+  r.x1 = a.x1 > b.x1 ? a.x1 : b.x1;
+  r.y1 = a.y1 > b.y1 ? a.y1 : b.y1;
+  return r;
+}
+
+static long long rect_area(rect_t r)
+{
+  if (rect_is_empty(r))
+    return 0;
+  return (long long) (r.x1 - r.x0) * (r.y1 - r.y0);
+}
+
+void rect_list_add(rect_list_t* list, rect_t r)
+{
+  if (rect_is_empty(r))
+    return;
+
+  // Merging can make the result overlap other rects, so keep going
+  // until nothing else is worth merging
+  for (int i = 0; i < list->count;)
+  {
+    rect_t u = rect_union(list->rects[i], r);
+    if (rect_area(u) <= rect_area(list->rects[i]) + rect_area(r))
+    {
+      r = u;
+      list->rects[i] = list->rects[--list->count];
+      i = 0;
+      continue;
+    }
+    i++;
+  }
+
+  if (list->count < MAX_DIRTY_RECTS)
+  {
+    list->rects[list->count++] = r;
+    return;
+  }
+
+  int best = 0;
+  long long best_growth = 0;
+  for (int i = 0; i < list->count; i++)
+  {
+    long long growth = rect_area(rect_union(list->rects[i], r)) - rect_area(list->rects[i]);
+    if (i == 0 || growth < best_growth)
+    {
+      best = i;
+      best_growth = growth;
+    }
+  }
+  list->rects[best] = rect_union(list->rects[best], r);
+}
+
+// Memory backend
+
+static void mem_fill_start(pixel_display_t* display)
+{
+}
+
+static void mem_fill_end(pixel_display_t* display)
+{
+}
+
+static void mem_destroy(pixel_display_t* display)
+{
+  pixel_free(display->buf);
+}
+
+static const pixel_display_backend_t mem_backend = {
+  .fill_start = mem_fill_start,
+  .fill_end = mem_fill_end,
+  .destroy = mem_destroy
+};
+
+void create_mem_pixel_display(pixel_display_t* display, size_t w, size_t h)
+{
+  display->w = w;
+  display->h = h;
+  display->buf = (pixel_t*) pixel_alloc(sizeof(pixel_t) * w * h);
+  display->dirty.count = 0;
+  display->quality = QUALITY_ALIASED;
+  display->blend = BLEND_REPLACE;
+  pixel_display_reset_clip(display);
+
+  display->backend = &mem_backend;
+  display->backend_data = NULL;
+}
+
+// Dispatch
+
+void delete_pixel_display(pixel_display_t* display)
+{
+  display->backend->destroy(display);
+  display->buf = NULL;
+  display->backend_data = NULL;
+}
+
+void pixel_display_fill_start(pixel_display_t* display)
+{
+  display->backend->fill_start(display);
+}
+
+void pixel_display_fill_end(pixel_display_t* display)
+{
+  display->backend->fill_end(display);
+  display->dirty.count = 0;
+}
+
+void pixel_display_set_clip(pixel_display_t* display, rect_t clip)
+{
+  pixel_display_reset_clip(display);
+  display->clip = rect_intersect(display->clip, clip);
+  if (rect_is_empty(display->clip))
+  {
+    rect_t none = {0, 0, 0, 0};
+    display->clip = none;
+  }
+}
+
+void pixel_display_reset_clip(pixel_display_t* display)
+{
+  display->clip.x0 = 0;
+  display->clip.y0 = 0;
+  display->clip.x1 = display->w;
+  display->clip.y1 = display->h;
+}
+
+void pixel_display_damage(pixel_display_t* display, rect_t rect)
+{
+  rect_list_add(&display->dirty, rect_intersect(rect, display->clip));
+}
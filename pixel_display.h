@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#pragma pack(push, 1)
+typedef struct
+{
+  uint8_t b;
+  uint8_t g;
+  uint8_t r;
+  uint8_t a;
+} pixel_t;
+#pragma pack(pop)
+
+// Pixel rectangle covering [x0, x1) x [y0, y1)
+typedef struct
+{
+  int x0;
+  int y0;
+  int x1;
+  int y1;
+} rect_t;
+
+#define MAX_DIRTY_RECTS 16
+
+// A short list of rects. Rects that mostly overlap are merged, and once
+// the list is full new rects are merged into the one that grows least.
+typedef struct
+{
+  rect_t rects[MAX_DIRTY_RECTS];
+  int count;
+} rect_list_t;
+
+// How the drawing functions render lines and outlines
+typedef enum
+{
+  QUALITY_ALIASED,
+  QUALITY_ANTIALIASED
+} draw_quality_t;
+
+// How the drawing functions combine a color with the pixels below it.
+// Colors are straight alpha except with BLEND_PREMULTIPLIED.
+//
+//   BLEND_REPLACE        color is written as is, alpha included
+//   BLEND_OVER           source over: color * a + dst * (1 - a)
+//   BLEND_ADD            dst + color * a, saturating
+//   BLEND_MULTIPLY       dst * (color * a + (1 - a))
+//   BLEND_PREMULTIPLIED  color + dst * (1 - a)
+//
+// Anti-aliased edges scale a by their coverage, and with BLEND_REPLACE
+// mix color with the pixel below by coverage alone.
+typedef enum
+{
+  BLEND_REPLACE,
+  BLEND_OVER,
+  BLEND_ADD,
+  BLEND_MULTIPLY,
+  BLEND_PREMULTIPLIED
+} blend_mode_t;
+
+typedef struct pixel_display_t pixel_display_t;
+
+// A backend owns the storage behind a display's pixel buffer. buf is only
+// guaranteed to be valid between pixel_display_fill_start() and
+// pixel_display_fill_end().
+typedef struct
+{
+  void (*fill_start)(pixel_display_t* display);
+  void (*fill_end)(pixel_display_t* display);
+  void (*destroy)(pixel_display_t* display);
+} pixel_display_backend_t;
+
+struct pixel_display_t
+{
+  size_t w;
+  size_t h;
+
+  pixel_t* buf;
+
+  // Regions written since the last pixel_display_fill_end()
+  rect_list_t dirty;
+  
+  // Drawing functions leave pixels outside the clip rect alone
+  rect_t clip;
+
+  // Aliased unless set otherwise
+  draw_quality_t quality;
+
+  // BLEND_REPLACE unless set otherwise, clears always replace
+  blend_mode_t blend;
+
+  const pixel_display_backend_t* backend;
+  void* backend_data;
+};
+
+#define PIXEL_DISPLAY_ALIGNMENT 64
+
+// Software backend: a heap buffer that needs no graphics context
+void create_mem_pixel_display(pixel_display_t* display, size_t w, size_t h);
+
+void delete_pixel_display(pixel_display_t* display);
+
+void pixel_display_fill_start(pixel_display_t* display);
+
+void pixel_display_fill_end(pixel_display_t* display);
+
+void pixel_display_set_clip(pixel_display_t* display, rect_t clip);
+
+void pixel_display_reset_clip(pixel_display_t* display);
+
+// Marks a region as written, clipped to the clip rect
+void pixel_display_damage(pixel_display_t* display, rect_t rect);
+
+bool rect_is_empty(rect_t r);
+
+bool rect_overlap(rect_t a, rect_t b);
+
+rect_t rect_intersect(rect_t a, rect_t b);
+
+rect_t rect_union(rect_t a, rect_t b);
+
+void rect_list_add(rect_list_t* list, rect_t r);
+
+void* pixel_alloc(size_t size);
+
+void pixel_free(void* ptr);
@@ -0,0 +1,419 @@
+#include <math.h>
+#include <stb/stretchy_buffer.h>
+
+#include "raster.h"
+
+void create_raster(raster_t* raster, job_pool_t* pool)
+{
+  raster->pool = pool;
+  raster->cmds = NULL;
+  raster->blend = BLEND_REPLACE;
+  raster->display = NULL;
+  raster->tiles_x = 0;
+  raster->tiles_y = 0;
+  raster->tile_cmds = NULL;
+  raster->band_jobs = NULL;
+  raster->fill_polygons = NULL;
+  raster->fill_rules = NULL;
+}
+
+void delete_raster(raster_t* raster)
+{
+  for (int i = 0; i < sb_count(raster->tile_cmds); i++)
+    sb_free(raster->tile_cmds[i]);
+  sb_free(raster->tile_cmds);
+  sb_free(raster->band_jobs);
+  sb_free(raster->fill_polygons);
+  sb_free(raster->fill_rules);
+  sb_free(raster->cmds);
+  raster->tile_cmds = NULL;
+  raster->band_jobs = NULL;
+  raster->cmds = NULL;
+}
+
+// Recording
+
+static raster_cmd_t* add_cmd(raster_t* raster, raster_cmd_type_t type, pixel_t color, polygon_t* p)
+{
+  raster_cmd_t cmd;
+  cmd.type = type;
+  cmd.color = color;
+  cmd.blend = raster->blend;
+  cmd.polygon = p;
+  cmd.args[0] = cmd.args[1] = cmd.args[2] = cmd.args[3] = 0;
+  cmd.first_band = 0;
+  cmd.num_bands = 0;
+  cmd.first_column = 0;
+  cmd.num_columns = 0;
+  cmd.tile_spans = NULL;
+  sb_push(raster->cmds, cmd);
+  return &sb_last(raster->cmds);
+}
+
+void raster_set_blend(raster_t* raster, blend_mode_t blend)
+{
+  raster->blend = blend;
+}
+
+void raster_clear(raster_t* raster, pixel_t color)
+{
+  add_cmd(raster, RASTER_CLEAR, color, NULL);
+}
+
+void raster_fill(raster_t* raster, pixel_t color, polygon_t* p, fill_rule_t rule)
+{
+  raster_cmd_t* cmd = add_cmd(raster, RASTER_FILL, color, p);
+  cmd->args[0] = rule;
+}
+
+void raster_fill_aa(raster_t* raster, pixel_t color, polygon_t* p, fill_rule_t rule)
+{
+  raster_cmd_t* cmd = add_cmd(raster, RASTER_FILL_AA, color, p);
+  cmd->args[0] = rule;
+}
+
+void raster_fill_triangles(raster_t* raster, pixel_t color, polygon_t* p, fill_rule_t rule)
+{
+  raster_cmd_t* cmd = add_cmd(raster, RASTER_FILL_TRIANGLES, color, p);
+  cmd->args[0] = rule;
+}
+
+void raster_bounds(raster_t* raster, pixel_t color, polygon_t* p)
+{
+  add_cmd(raster, RASTER_BOUNDS, color, p);
+}
+
+void raster_points(raster_t* raster, pixel_t color, polygon_t* p, unsigned int radius)
+{
+  raster_cmd_t* cmd = add_cmd(raster, RASTER_POINTS, color, p);
+  cmd->args[0] = radius;
+}
+
+void raster_line(raster_t* raster, pixel_t color, int x1, int y1, int x2, int y2)
+{
+  raster_cmd_t* cmd = add_cmd(raster, RASTER_LINE, color, NULL);
+  cmd->args[0] = x1;
+  cmd->args[1] = y1;
+  cmd->args[2] = x2;
+  cmd->args[3] = y2;
+}
+
+void raster_point(raster_t* raster, pixel_t color, int x, int y, unsigned int radius)
+{
+  raster_cmd_t* cmd = add_cmd(raster, RASTER_POINT, color, NULL);
+  cmd->args[0] = x;
+  cmd->args[1] = y;
+  cmd->args[2] = radius;
+}
+
+// Binning
+
+static rect_t point_rect(int x, int y, int radius)
+{
+  rect_t r = {.x0 = x - radius, .y0 = y - radius, .x1 = x + radius + 1, .y1 = y + radius + 1};
+  return r;
+}
+
+// Points are truncated to ints when drawn, pad the bounds for that
+static rect_t outline_rect(polygon_t* p, int radius)
+{
+  rect_t r = {0, 0, 0, 0};
+  if (!p->num_points)
+    return r;
+  
+  aabb_t b = polygon_bounds(p);
+  r.x0 = floorf(b.min.x) - 1 - radius;
+  r.y0 = floorf(b.min.y) - 1 - radius;
+  r.x1 = floorf(b.max.x) + 2 + radius;
+  r.y1 = floorf(b.max.y) + 2 + radius;
+  return r;
+}
+
+// Works out what each command can touch, and warms the polygon caches so
+// the parallel stages only read them
+static void prepare_cmd(raster_t* raster, raster_cmd_t* cmd)
+{
+  pixel_display_t* display = raster->display;
+  rect_t none = {0, 0, 0, 0};
+  int* a = cmd->args;
+
+  // Polygons with no triangles go down the span fill path instead
+  if (cmd->type == RASTER_FILL_TRIANGLES)
+  {
+    size_t num_triangles;
+    cmd->polygon = scan_fill_polygon(display, cmd->polygon);
+    if (!polygon_triangles(cmd->polygon, &num_triangles))
+      cmd->type = RASTER_FILL;
+  }
+  
+  switch (cmd->type)
+  {
+   case RASTER_CLEAR:
+     cmd->rect = display->clip;
+     break;
+   case RASTER_FILL:
+   {
+     int y_lo, y_hi;
+     cmd->polygon = scan_fill_polygon(display, cmd->polygon);
+     cmd->rect = none;
+     if (!scan_fill_range(display, cmd->polygon, &y_lo, &y_hi))
+       break;
+     
+     cmd->rect = scan_fill_rect(cmd->polygon);
+     cmd->rect.y0 = y_lo;
+     cmd->rect.y1 = y_hi;
+     cmd->rect = rect_intersect(cmd->rect, display->clip);
+     if (rect_is_empty(cmd->rect))
+       break;
+
+     // One span job for each band of tile rows
+     cmd->first_band = cmd->rect.y0 / TILE_SIZE;
+     cmd->num_bands = (cmd->rect.y1 - 1) / TILE_SIZE - cmd->first_band + 1;
+     cmd->first_column = cmd->rect.x0 / TILE_SIZE;
+     cmd->num_columns = (cmd->rect.x1 - 1) / TILE_SIZE - cmd->first_column + 1;
+     cmd->tile_spans = (span_t**) calloc(cmd->num_bands * cmd->num_columns, sizeof(span_t*));
+     sb_push(raster->fill_polygons, cmd->polygon);
+     sb_push(raster->fill_rules, (fill_rule_t) a[0]);
+     for (int i = 0; i < cmd->num_bands; i++)
+     {
+       raster_band_job_t job = {.cmd = cmd - raster->cmds, .band = i};
+       sb_push(raster->band_jobs, job);
+     }
+     break;
+   }
+   case RASTER_FILL_AA:
+     cmd->polygon = scan_fill_polygon(display, cmd->polygon);
+     cmd->rect = scan_fill_aa_rect(cmd->polygon);
+     break;
+   case RASTER_FILL_TRIANGLES:
+     cmd->rect = triangle_fill_rect(cmd->polygon);
+     break;
+   case RASTER_BOUNDS:
+     cmd->rect = outline_rect(cmd->polygon, 0);
+     break;
+   case RASTER_POINTS:
+     cmd->rect = outline_rect(cmd->polygon, a[0]);
+     break;
+   case RASTER_LINE:
+     cmd->rect.x0 = a[0] < a[2] ? a[0] : a[2];
+     cmd->rect.y0 = a[1] < a[3] ? a[1] : a[3];
+     cmd->rect.x1 = (a[0] < a[2] ? a[2] : a[0]) + 1;
+     cmd->rect.y1 = (a[1] < a[3] ? a[3] : a[1]) + 1;
+     if (display->quality == QUALITY_ANTIALIASED)
+     {
+       cmd->rect.x0--;
+       cmd->rect.y0--;
+       cmd->rect.x1++;
+       cmd->rect.y1++;
+     }
+     break;
+   case RASTER_POINT:
+     cmd->rect = point_rect(a[0], a[1], a[2]);
+     break;
+  }
+  
+  cmd->rect = rect_intersect(cmd->rect, display->clip);
+}
+
+typedef struct
+{
+  raster_cmd_t* cmd;
+  span_t** columns; // the tile spans of one band
+} band_target_t;
+
+// Clips a span to the command and splits it at tile edges
+static void emit_band_span(void* data, int y, int x0, int x1)
+{
+  band_target_t* target = (band_target_t*) data;
+  raster_cmd_t* cmd = target->cmd;
+  if (x0 < cmd->rect.x0)
+    x0 = cmd->rect.x0;
+  if (x1 > cmd->rect.x1)
+    x1 = cmd->rect.x1;
+
+  while (x0 < x1)
+  {
+    int column = x0 / TILE_SIZE;
+    int end = (column + 1) * TILE_SIZE;
+    span_t span = {.y = y, .x0 = x0, .x1 = x1 < end ? x1 : end};
+    sb_push(target->columns[column - cmd->first_column], span);
+    x0 = span.x1;
+  }
+}
+
+static void fill_band(void* data, int index)
+{
+  raster_t* raster = (raster_t*) data;
+  raster_band_job_t* job = raster->band_jobs + index;
+  raster_cmd_t* cmd = raster->cmds + job->cmd;
+
+  int band = cmd->first_band + job->band;
+  int y_lo = band * TILE_SIZE;
+  int y_hi = y_lo + TILE_SIZE;
+  if (y_lo < cmd->rect.y0)
+    y_lo = cmd->rect.y0;
+  if (y_hi > cmd->rect.y1)
+    y_hi = cmd->rect.y1;
+  
+  // The span caches are up to date, so this only reads them
+  size_t num_spans;
+  const span_t* spans = scan_fill_spans(raster->display, cmd->polygon, cmd->args[0],
+                                        y_lo, y_hi, &num_spans);
+  band_target_t target = {.cmd = cmd, .columns = cmd->tile_spans + (job->band * cmd->num_columns)};
+  for (size_t i = 0; i < num_spans; i++)
+    emit_band_span(&target, spans[i].y, spans[i].x0, spans[i].x1);
+}
+
+static void bin_cmds(raster_t* raster)
+{
+  pixel_display_t* display = raster->display;
+  int tiles_x = (display->w + TILE_SIZE - 1) / TILE_SIZE;
+  int tiles_y = (display->h + TILE_SIZE - 1) / TILE_SIZE;
+  
+  while (sb_count(raster->tile_cmds) < tiles_x * tiles_y)
+    sb_push(raster->tile_cmds, NULL);
+  for (int i = 0; i < sb_count(raster->tile_cmds); i++)
+  {
+    if (raster->tile_cmds[i])
+      stb__sbn(raster->tile_cmds[i]) = 0;
+  }
+  raster->tiles_x = tiles_x;
+  raster->tiles_y = tiles_y;
+
+  for (int i = 0; i < sb_count(raster->cmds); i++)
+  {
+    rect_t r = raster->cmds[i].rect;
+    if (rect_is_empty(r))
+      continue;
+    
+    for (int ty = r.y0 / TILE_SIZE; ty <= (r.y1 - 1) / TILE_SIZE; ty++)
+    {
+      for (int tx = r.x0 / TILE_SIZE; tx <= (r.x1 - 1) / TILE_SIZE; tx++)
+        sb_push(raster->tile_cmds[tx + (ty * tiles_x)], i);
+    }
+  }
+}
+
+// Drawing
+
+static void draw_cmd(pixel_display_t* display, raster_cmd_t* cmd)
+{
+  int* a = cmd->args;
+  display->blend = cmd->blend;
+  
+  switch (cmd->type)
+  {
+   case RASTER_CLEAR:
+     clear_display(display, cmd->color);
+     break;
+   case RASTER_FILL:
+     scan_fill(display, cmd->color, cmd->polygon, a[0]);
+     break;
+   case RASTER_FILL_AA:
+     scan_fill_aa(display, cmd->color, cmd->polygon, a[0]);
+     break;
+   case RASTER_FILL_TRIANGLES:
+     triangle_fill(display, cmd->color, cmd->polygon, a[0]);
+     break;
+   case RASTER_BOUNDS:
+     draw_polygon_bounds(display, cmd->color, cmd->polygon);
+     break;
+   case RASTER_POINTS:
+     draw_polygon_points(display, cmd->color, cmd->polygon, a[0]);
+     break;
+   case RASTER_LINE:
+     draw_line(display, cmd->color, a[0], a[1], a[2], a[3]);
+     break;
+   case RASTER_POINT:
+     draw_point(display, cmd->color, a[0], a[1], a[2]);
+     break;
+  }
+}
+
+static void draw_tile(void* data, int tile)
+{
+  raster_t* raster = (raster_t*) data;
+  int* cmds = raster->tile_cmds[tile];
+  if (!sb_count(cmds))
+    return;
+
+  int tx = tile % raster->tiles_x;
+  int ty = tile / raster->tiles_x;
+  rect_t tile_rect = {.x0 = tx * TILE_SIZE, .y0 = ty * TILE_SIZE,
+                      .x1 = (tx + 1) * TILE_SIZE, .y1 = (ty + 1) * TILE_SIZE};
+
+  // Each tile draws through its own view of the display, so no two
+  // threads share a clip rect or dirty list
+  pixel_display_t view = *raster->display;
+  view.dirty.count = 0;
+  view.clip = rect_intersect(view.clip, tile_rect);
+  
+  for (int i = 0; i < sb_count(cmds); i++)
+  {
+    raster_cmd_t* cmd = raster->cmds + cmds[i];
+    if (cmd->type == RASTER_FILL)
+    {
+      int band = ty - cmd->first_band;
+      span_t* spans = cmd->tile_spans[(band * cmd->num_columns) + tx - cmd->first_column];
+      view.blend = cmd->blend;
+      fill_spans(&view, cmd->color, spans, sb_count(spans));
+    }
+    else
+      draw_cmd(&view, cmd);
+  }
+}
+
+// Without worker threads tiling only adds overhead, so the commands are
+// run straight on the display
+static void draw_cmds(raster_t* raster, pixel_display_t* display)
+{
+  blend_mode_t blend = display->blend;
+  for (int i = 0; i < sb_count(raster->cmds); i++)
+    draw_cmd(display, raster->cmds + i);
+  display->blend = blend;
+  
+  stb__sbn(raster->cmds) = 0;
+}
+
+void raster_flush(raster_t* raster, pixel_display_t* display)
+{
+  if (!sb_count(raster->cmds))
+    return;
+  if (!raster->pool || !raster->pool->num_threads)
+  {
+    draw_cmds(raster, display);
+    return;
+  }
+  
+  raster->display = display;
+  
+  for (int i = 0; i < sb_count(raster->cmds); i++)
+    prepare_cmd(raster, raster->cmds + i);
+
+  scan_fill_update_spans(display, raster->fill_polygons, raster->fill_rules,
+                         sb_count(raster->fill_polygons), raster->pool);
+  job_parallel_for(raster->pool, sb_count(raster->band_jobs), fill_band, raster);
+  
+  bin_cmds(raster);
+  job_parallel_for(raster->pool, raster->tiles_x * raster->tiles_y, draw_tile, raster);
+
+  for (int i = 0; i < sb_count(raster->cmds); i++)
+  {
+    raster_cmd_t* cmd = raster->cmds + i;
+    pixel_display_damage(display, cmd->rect);
+    
+    for (int j = 0; j < cmd->num_bands * cmd->num_columns; j++)
+      sb_free(cmd->tile_spans[j]);
+    free(cmd->tile_spans);
+  }
+  
+  stb__sbn(raster->cmds) = 0;
+  if (raster->band_jobs)
+    stb__sbn(raster->band_jobs) = 0;
+  if (raster->fill_polygons)
+  {
+    stb__sbn(raster->fill_polygons) = 0;
+    stb__sbn(raster->fill_rules) = 0;
+  }
+  raster->display = NULL;
+}
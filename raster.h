@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "pixel_display.h"
+#include "geom.h"
+#include "draw.h"
+#include "job.h"
+
+// Tile binned renderer
+//
+// Drawing commands are recorded, then raster_flush() splits the display
+// into TILE_SIZE x TILE_SIZE tiles and bins each command into the tiles it
+// overlaps. Tiles are drawn in parallel on a job pool; every tile is drawn
+// by one thread, running its commands in order, clipped to the tile. The
+// result is the same as running the commands directly with draw.c, which
+// is what happens when there are no worker threads.
+//
+// Fills have their span caches brought up to date up front, scanning in
+// parallel, then the cached spans of each band of tile rows are split up
+// between the tiles of the band. A large polygon is not scanned again for
+// every tile, or at all if it has not changed since it was last filled,
+// and a tile only sees its spans.
+
+#define TILE_SIZE 64
+
+typedef enum
+{
+  RASTER_CLEAR,
+  RASTER_FILL,
+  RASTER_FILL_AA,
+  RASTER_FILL_TRIANGLES,
+  RASTER_BOUNDS,
+  RASTER_POINTS,
+  RASTER_LINE,
+  RASTER_POINT
+} raster_cmd_type_t;
+
+typedef struct
+{
+  raster_cmd_type_t type;
+  pixel_t color;
+  blend_mode_t blend;
+  polygon_t* polygon;
+  int args[4];
+
+  // Filled in by raster_flush()
+  rect_t rect;    // pixels the command may touch
+  int first_band; // fills: spans for each tile under rect, by band then
+  int num_bands;  // column
+  int first_column;
+  int num_columns;
+  span_t** tile_spans;
+} raster_cmd_t;
+
+typedef struct
+{
+  int cmd;
+  int band;
+} raster_band_job_t;
+
+typedef struct
+{
+  job_pool_t* pool;
+  raster_cmd_t* cmds;
+  blend_mode_t blend; // for commands recorded from now on
+
+  // Scratch for raster_flush(), kept between flushes
+  pixel_display_t* display;
+  int tiles_x;
+  int tiles_y;
+  int** tile_cmds; // command indices binned to each tile
+  raster_band_job_t* band_jobs;
+  polygon_t** fill_polygons; // fills whose span caches to update
+  fill_rule_t* fill_rules;
+} raster_t;
+
+// pool may be NULL to draw on the calling thread only
+void create_raster(raster_t* raster, job_pool_t* pool);
+
+void delete_raster(raster_t* raster);
+
+// Blend mode of the commands recorded after this, BLEND_REPLACE to start
+// with. It replaces the display's own mode while they are drawn.
+void raster_set_blend(raster_t* raster, blend_mode_t blend);
+
+// Polygons are read when the commands are flushed, not when recorded
+void raster_clear(raster_t* raster, pixel_t color);
+
+void raster_fill(raster_t* raster, pixel_t color, polygon_t* p, fill_rule_t rule);
+
+// Tiles run scan_fill_aa over their own pixels, coverage does not depend
+// on the clip
+void raster_fill_aa(raster_t* raster, pixel_t color, polygon_t* p, fill_rule_t rule);
+
+// Tiles run triangle_fill over their own pixels. Polygons without a
+// triangulation are filled as by raster_fill.
+void raster_fill_triangles(raster_t* raster, pixel_t color, polygon_t* p, fill_rule_t rule);
+
+void raster_bounds(raster_t* raster, pixel_t color, polygon_t* p);
+
+void raster_points(raster_t* raster, pixel_t color, polygon_t* p, unsigned int radius);
+
+void raster_line(raster_t* raster, pixel_t color, int x1, int y1, int x2, int y2);
+
+void raster_point(raster_t* raster, pixel_t color, int x, int y, unsigned int radius);
+
+// Draws the recorded commands into the display's clip rect, then clears
+// the command list
+void raster_flush(raster_t* raster, pixel_display_t* display);
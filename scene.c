@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stb/stretchy_buffer.h>
+
+#include "scene.h"
+#include "draw.h"
+#include "raster.h"
+
+#define MAX_LINE 4096
+
+static void create_scene(scene_t* scene)
+{
+  scene->w = 0;
+  scene->h = 0;
+  scene->antialias = false;
+  scene->polygons = NULL;
+  scene->cmds = NULL;
+}
+
+void delete_scene(scene_t* scene)
+{
+  for (int i = 0; i < sb_count(scene->polygons); i++)
+  {
+    delete_polygon(scene->polygons + i);
+  }
+  sb_free(scene->polygons);
+  sb_free(scene->cmds);
+  create_scene(scene);
+}
+
+// Reads up to max numbers from s, returns how many were read
+static int parse_numbers(const char* s, float* vals, int max)
+{
+  int n = 0;
+  char* end;
+  while (n < max)
+  {
+    float v = strtof(s, &end);
+    if (end == s)
+      break;
+    vals[n++] = v;
+    s = end;
+  }
+
+  while (isspace((unsigned char) *s))
+    s++;
+  if (*s)
+    return -1;
+  return n;
+}
+
+// Optional fill rule word, even-odd if there is none
+static bool parse_fill_rule(const char* s, fill_rule_t* rule)
+{
+  char word[16];
+  char extra;
+  *rule = FILL_EVEN_ODD;
+  int n = sscanf(s, " %15s %c", word, &extra);
+  if (n <= 0)
+    return true;
+  if (n > 1)
+    return false;
+
+  if (!strcmp(word, "nonzero"))
+    *rule = FILL_NON_ZERO;
+  else if (strcmp(word, "evenodd"))
+    return false;
+  return true;
+}
+
+static bool parse_blend_mode(const char* s, blend_mode_t* mode)
+{
+  static const char* names[] = {"replace", "over", "add", "multiply", "premultiplied"};
+  char word[16];
+  char extra;
+  if (sscanf(s, " %15s %c", word, &extra) != 1)
+    return false;
+  
+  for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+  {
+    if (!strcmp(word, names[i]))
+    {
+      *mode = (blend_mode_t) i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Channels out of 0..255, NaN included, are rejected
+static bool parse_color(const float* vals, int n, pixel_t* color)
+{
+  for (int i = 0; i < n; i++)
+  {
+    if (!(vals[i] >= 0 && vals[i] <= 255))
+      return false;
+  }
+
+  color->r = vals[0];
+  color->g = vals[1];
+  color->b = vals[2];
+  color->a = n > 3 ? vals[3] : 255;
+  return true;
+}
+
+static bool parse_polygon(scene_t* scene, const char* s)
+{
+  point_t* points = NULL;
+  char* end;
+  for (;;)
+  {
+    point_t point;
+    point.x = strtof(s, &end);
+    if (end == s)
+      break;
+    s = end;
+    point.y = strtof(s, &end);
+    if (end == s)
+    {
+      sb_free(points);
+      return false;
+    }
+    s = end;
+    sb_push(points, point);
+  }
+  
+  while (isspace((unsigned char) *s))
+    s++;
+  if (*s || sb_count(points) < 3)
+  {
+    sb_free(points);
+    return false;
+  }
+
+  polygon_t poly;
+  create_polygon_from_points(&poly, points, sb_count(points));
+  sb_push(scene->polygons, poly);
+  sb_free(points);
+  return true;
+}
+
+bool load_scene(scene_t* scene, const char* pathname)
+{
+  create_scene(scene);
+  
+  FILE* file = fopen(pathname, "r");
+  if (!file)
+  {
+    fprintf(stderr, "Unable to load file %s.\n", pathname);
+    return false;
+  }
+
+  // Lines can be longer than MAX_LINE for big polygons, so grow as needed
+  size_t line_size = MAX_LINE;
+  char* line = (char*) malloc(line_size);
+  
+  pixel_t color = {.r = 0, .g = 0, .b = 0, .a = 255};
+  blend_mode_t blend = BLEND_REPLACE;
+  int line_num = 0;
+  const char* error = NULL;
+  
+  while (!error && fgets(line, line_size, file))
+  {
+    size_t len = strlen(line);
+    while (len == line_size - 1 && line[len - 1] != '\n')
+    {
+      line_size *= 2;
+      line = (char*) realloc(line, line_size);
+      if (!fgets(line + len, line_size - len, file))
+        break;
+      len += strlen(line + len);
+    }
+    line_num++;
+
+    char* comment = strchr(line, '#');
+    if (comment)
+      *comment = 0;
+    
+    char cmd[32];
+    int cmd_len = 0;
+    if (sscanf(line, " %31s%n", cmd, &cmd_len) != 1)
+      continue;
+    const char* rest = line + cmd_len;
+
+    float vals[5];
+    int n;
+    scene_cmd_t new_cmd;
+    new_cmd.color = color;
+    new_cmd.blend = blend;
+    new_cmd.polygon = sb_count(scene->polygons) - 1;
+    memset(new_cmd.args, 0, sizeof(new_cmd.args));
+
+    if (!strcmp(cmd, "size"))
+    {
+      n = parse_numbers(rest, vals, 2);
+      if (n != 2 || vals[0] < 1 || vals[1] < 1)
+      {
+        error = "invalid size";
+        continue;
+      }
+      scene->w = vals[0];
+      scene->h = vals[1];
+      continue;
+    }
+    
+    if (!scene->w)
+    {
+      error = "expected size first";
+      continue;
+    }
+    
+    if (!strcmp(cmd, "antialias"))
+    {
+      if (parse_numbers(rest, vals, 0))
+        error = "invalid command";
+      scene->antialias = true;
+      continue;
+    }
+    else if (!strcmp(cmd, "blend"))
+    {
+      if (!parse_blend_mode(rest, &blend))
+        error = "invalid blend mode";
+      continue;
+    }
+    else if (!strcmp(cmd, "polygon"))
+    {
+      if (!parse_polygon(scene, rest))
+        error = "invalid polygon";
+      continue;
+    }
+    else if (!strcmp(cmd, "color") || !strcmp(cmd, "clear"))
+    {
+      pixel_t parsed;
+      n = parse_numbers(rest, vals, 4);
+      if (n < 3 || !parse_color(vals, n, &parsed))
+      {
+        error = "invalid command";
+        continue;
+      }
+      if (!strcmp(cmd, "color"))
+      {
+        color = parsed;
+        continue;
+      }
+      new_cmd.type = SCENE_CLEAR;
+      new_cmd.color = parsed;
+    }
+    else if (!strcmp(cmd, "fill"))
+    {
+      fill_rule_t rule;
+      if (new_cmd.polygon < 0 || !parse_fill_rule(rest, &rule))
+      {
+        error = "invalid command";
+        continue;
+      }
+      new_cmd.type = SCENE_FILL;
+      new_cmd.args[0] = rule;
+    }
+    else if (!strcmp(cmd, "bounds")
+             || !strcmp(cmd, "points"))
+    {
+      n = parse_numbers(rest, vals, 1);
+      if (new_cmd.polygon < 0 || n < 0)
+      {
+        error = "invalid command";
+        continue;
+      }
+      if (cmd[0] == 'b')
+        new_cmd.type = SCENE_BOUNDS;
+      else
+        new_cmd.type = SCENE_POINTS;
+      new_cmd.args[0] = n > 0 ? vals[0] : 0;
+    }
+    else if (!strcmp(cmd, "line"))
+    {
+      n = parse_numbers(rest, vals, 4);
+      if (n != 4)
+      {
+        error = "invalid command";
+        continue;
+      }
+      new_cmd.type = SCENE_LINE;
+      for (int i = 0; i < 4; i++)
+        new_cmd.args[i] = vals[i];
+    }
+    else if (!strcmp(cmd, "point"))
+    {
+      n = parse_numbers(rest, vals, 3);
+      if (n < 2)
+      {
+        error = "invalid command";
+        continue;
+      }
+      new_cmd.type = SCENE_POINT;
+      for (int i = 0; i < n; i++)
+        new_cmd.args[i] = vals[i];
+    }
+    else
+    {
+      error = "invalid command";
+      continue;
+    }
+    
+    sb_push(scene->cmds, new_cmd);
+  }
+
+  if (!error && !scene->w)
+    error = "missing size";
+  if (error)
+    fprintf(stderr, "%s:%d: %s.\n", pathname, line_num, error);
+  
+  free(line);
+  fclose(file);
+
+  if (error)
+    delete_scene(scene);
+  return !error;
+}
+
+static void render_scene_tiled(scene_t* scene, pixel_display_t* display, job_pool_t* pool)
+{
+  // Polygons are independent, so their caches are built in parallel up
+  // front rather than one after another while flushing
+  polygon_set_update_caches(scene->polygons, sb_count(scene->polygons), pool);
+  
+  raster_t raster;
+  create_raster(&raster, pool);
+  
+  for (int i = 0; i < sb_count(scene->cmds); i++)
+  {
+    scene_cmd_t* cmd = scene->cmds + i;
+    polygon_t* p = cmd->polygon >= 0 ? scene->polygons + cmd->polygon : NULL;
+    raster_set_blend(&raster, cmd->blend);
+    
+    switch (cmd->type)
+    {
+     case SCENE_CLEAR:
+       raster_clear(&raster, cmd->color);
+       break;
+     case SCENE_FILL:
+       if (scene->antialias)
+         raster_fill_aa(&raster, cmd->color, p, cmd->args[0]);
+       else
+         raster_fill(&raster, cmd->color, p, cmd->args[0]);
+       break;
+     case SCENE_BOUNDS:
+       raster_bounds(&raster, cmd->color, p);
+       break;
+     case SCENE_POINTS:
+       raster_points(&raster, cmd->color, p, cmd->args[0]);
+       break;
+     case SCENE_LINE:
+       raster_line(&raster, cmd->color,
+                   cmd->args[0], cmd->args[1], cmd->args[2], cmd->args[3]);
+       break;
+     case SCENE_POINT:
+       raster_point(&raster, cmd->color, cmd->args[0], cmd->args[1], cmd->args[2]);
+       break;
+    }
+  }
+
+  raster_flush(&raster, display);
+  delete_raster(&raster);
+}
+
+void render_scene(scene_t* scene, pixel_display_t* display, job_pool_t* pool)
+{
+  display->quality = scene->antialias ? QUALITY_ANTIALIASED : QUALITY_ALIASED;
+  
+  if (pool)
+  {
+    render_scene_tiled(scene, display, pool);
+    return;
+  }
+  
+  blend_mode_t blend = display->blend;
+  for (int i = 0; i < sb_count(scene->cmds); i++)
+  {
+    scene_cmd_t* cmd = scene->cmds + i;
+    polygon_t* p = cmd->polygon >= 0 ? scene->polygons + cmd->polygon : NULL;
+    display->blend = cmd->blend;
+    
+    switch (cmd->type)
+    {
+     case SCENE_CLEAR:
+       clear_display(display, cmd->color);
+       break;
+     case SCENE_FILL:
+       if (scene->antialias)
+         scan_fill_aa(display, cmd->color, p, cmd->args[0]);
+       else
+         scan_fill(display, cmd->color, p, cmd->args[0]);
+       break;
+     case SCENE_BOUNDS:
+       draw_polygon_bounds(display, cmd->color, p);
+       break;
+     case SCENE_POINTS:
+       draw_polygon_points(display, cmd->color, p, cmd->args[0]);
+       break;
+     case SCENE_LINE:
+       draw_line(display, cmd->color,
+                 cmd->args[0], cmd->args[1], cmd->args[2], cmd->args[3]);
+       break;
+     case SCENE_POINT:
+       draw_point(display, cmd->color, cmd->args[0], cmd->args[1], cmd->args[2]);
+       break;
+    }
+  }
+  display->blend = blend;
+}
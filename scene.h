@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "pixel_display.h"
+#include "geom.h"
+#include "job.h"
+
+// Scene files are plain text, one command per line. '#' starts a comment.
+//
+//   size w h                   canvas size, must come first
+//   antialias                  draw lines, outlines and fills anti-aliased
+//   clear r g b [a]            clear the canvas
+//   color r g b [a]            set the color used by later commands
+//                              (channels are 0 to 255)
+//   blend mode                 set how later commands blend, one of replace
+//                              (the default), over, add, multiply or
+//                              premultiplied, see blend_mode_t
+//   polygon x y x y ...        add a closed polygon, it becomes the current polygon
+//   fill [evenodd|nonzero]     scan fill the current polygon by the fill
+//                              rule, even-odd by default
+//   bounds                     draw the outline of the current polygon
+//   points radius              draw the vertices of the current polygon
+//   line x1 y1 x2 y2
+//   point x y [radius]
+
+typedef enum
+{
+  SCENE_CLEAR,
+  SCENE_FILL,
+  SCENE_BOUNDS,
+  SCENE_POINTS,
+  SCENE_LINE,
+  SCENE_POINT
+} scene_cmd_type_t;
+
+typedef struct
+{
+  scene_cmd_type_t type;
+  pixel_t color;
+  blend_mode_t blend;
+  int polygon;
+  int args[4];
+} scene_cmd_t;
+
+typedef struct
+{
+  size_t w;
+  size_t h;
+  bool antialias;
+  
+  polygon_t* polygons;
+  scene_cmd_t* cmds;
+} scene_t;
+
+bool load_scene(scene_t* scene, const char* pathname);
+
+void delete_scene(scene_t* scene);
+
+// With a job pool the scene is drawn by the tile renderer, see raster.h.
+// The output is the same either way. Sets the display's quality, its
+// blend mode is left as it was.
+void render_scene(scene_t* scene, pixel_display_t* display, job_pool_t* pool);
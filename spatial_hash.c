@@ -0,0 +1,228 @@
+#include <math.h>
+#include <stb/stretchy_buffer.h>
+
+#include "spatial_hash.h"
+
+#define MIN_TABLE_SIZE 256
+
+static size_t cell_hash(spatial_hash_t* hash, int x, int y)
+{
+  unsigned int h = ((unsigned int) x * 73856093u) ^ ((unsigned int) y * 19349663u);
+  return h & (hash->table_size - 1);
+}
+
+static int cell_coord(spatial_hash_t* hash, float v)
+{
+  return (int) floorf(v / hash->cell_size);
+}
+
+static void alloc_table(spatial_hash_t* hash, size_t table_size)
+{
+  free(hash->table);
+  hash->table_size = table_size;
+  hash->table = (int*) malloc(sizeof(int) * table_size);
+  for (size_t i = 0; i < table_size; i++)
+    hash->table[i] = -1;
+}
+
+// Slot of cell (x, y) in the table, or of the empty slot it would go in
+static size_t table_slot(spatial_hash_t* hash, int x, int y)
+{
+  size_t i = cell_hash(hash, x, y);
+  for (;;)
+  {
+    int cell = hash->table[i];
+    if (cell < 0
+        || (hash->cells[cell].x == x && hash->cells[cell].y == y))
+      return i;
+    i = (i + 1) & (hash->table_size - 1);
+  }
+}
+
+static int find_cell(spatial_hash_t* hash, int x, int y)
+{
+  return hash->table[table_slot(hash, x, y)];
+}
+
+// Keep the table at most half full
+static void maybe_grow(spatial_hash_t* hash)
+{
+  size_t count = sb_count(hash->cells);
+  if ((count + 1) * 2 <= hash->table_size)
+    return;
+
+  alloc_table(hash, hash->table_size * 2);
+  for (size_t i = 0; i < count; i++)
+    hash->table[table_slot(hash, hash->cells[i].x, hash->cells[i].y)] = i;
+}
+
+static int get_cell(spatial_hash_t* hash, int x, int y)
+{
+  int cell = find_cell(hash, x, y);
+  if (cell >= 0)
+    return cell;
+
+  maybe_grow(hash);
+  
+  spatial_cell_t c = {.x = x, .y = y, .items = NULL};
+  cell = sb_count(hash->cells);
+  sb_push(hash->cells, c);
+  hash->table[table_slot(hash, x, y)] = cell;
+  return cell;
+}
+
+void create_spatial_hash(spatial_hash_t* hash, float cell_size)
+{
+  hash->cell_size = cell_size;
+  hash->cells = NULL;
+  hash->table = NULL;
+  hash->handles = NULL;
+  alloc_table(hash, MIN_TABLE_SIZE);
+}
+
+void delete_spatial_hash(spatial_hash_t* hash)
+{
+  spatial_hash_clear(hash);
+  free(hash->table);
+  hash->table = NULL;
+  hash->table_size = 0;
+}
+
+void spatial_hash_clear(spatial_hash_t* hash)
+{
+  for (int i = 0; i < sb_count(hash->handles); i++)
+    sb_free(hash->handles[i]);
+  sb_free(hash->handles);
+  hash->handles = NULL;
+  
+  for (int i = 0; i < sb_count(hash->cells); i++)
+    sb_free(hash->cells[i].items);
+  sb_free(hash->cells);
+  hash->cells = NULL;
+  
+  for (size_t i = 0; i < hash->table_size; i++)
+    hash->table[i] = -1;
+}
+
+static spatial_handle_t* get_handle(spatial_hash_t* hash, vertex_ref_t ref)
+{
+  while (sb_count(hash->handles) <= ref.poly)
+    sb_push(hash->handles, NULL);
+  
+  spatial_handle_t** points = hash->handles + ref.poly;
+  spatial_handle_t none = {.cell = -1, .slot = -1};
+  while (sb_count(*points) <= ref.point)
+    sb_push(*points, none);
+  
+  return *points + ref.point;
+}
+
+static void cell_add(spatial_hash_t* hash, spatial_handle_t* handle, int cell,
+                     vertex_ref_t ref, point_t pos)
+{
+  spatial_item_t item = {.pos = pos, .ref = ref};
+  spatial_cell_t* c = hash->cells + cell;
+  handle->cell = cell;
+  handle->slot = sb_count(c->items);
+  sb_push(c->items, item);
+}
+
+// Swaps the last item of the cell into the hole
+static void cell_remove(spatial_hash_t* hash, spatial_handle_t* handle)
+{
+  spatial_cell_t* c = hash->cells + handle->cell;
+  spatial_item_t last = sb_last(c->items);
+  c->items[handle->slot] = last;
+  hash->handles[last.ref.poly][last.ref.point].slot = handle->slot;
+  stb__sbn(c->items)--;
+}
+
+void spatial_hash_insert(spatial_hash_t* hash, vertex_ref_t ref, point_t pos)
+{
+  spatial_handle_t* handle = get_handle(hash, ref);
+  if (handle->cell >= 0)
+  {
+    spatial_hash_move(hash, ref, pos);
+    return;
+  }
+
+  int cell = get_cell(hash, cell_coord(hash, pos.x), cell_coord(hash, pos.y));
+  cell_add(hash, handle, cell, ref, pos);
+}
+
+void spatial_hash_move(spatial_hash_t* hash, vertex_ref_t ref, point_t pos)
+{
+  spatial_handle_t* handle = get_handle(hash, ref);
+  if (handle->cell < 0)
+    return;
+  
+  int x = cell_coord(hash, pos.x);
+  int y = cell_coord(hash, pos.y);
+  spatial_cell_t* c = hash->cells + handle->cell;
+  if (c->x == x && c->y == y)
+  {
+    c->items[handle->slot].pos = pos;
+    return;
+  }
+
+  cell_remove(hash, handle);
+  cell_add(hash, handle, get_cell(hash, x, y), ref, pos);
+}
+
+void spatial_hash_update_polygon(spatial_hash_t* hash, int poly, polygon_t* p)
+{
+  for (int i = 0; i < p->num_points; i++)
+  {
+    vertex_ref_t ref = {.poly = poly, .point = i};
+    spatial_hash_insert(hash, ref, p->points[i]);
+  }
+}
+
+static bool ref_less(vertex_ref_t a, vertex_ref_t b)
+{
+  return a.poly < b.poly || (a.poly == b.poly && a.point < b.point);
+}
+
+bool spatial_hash_nearest(spatial_hash_t* hash, point_t pos, float max_d, int poly,
+                          vertex_ref_t* result)
+{
+  int x0 = cell_coord(hash, pos.x - max_d);
+  int x1 = cell_coord(hash, pos.x + max_d);
+  int y0 = cell_coord(hash, pos.y - max_d);
+  int y1 = cell_coord(hash, pos.y + max_d);
+  
+  float best_d = max_d * max_d;
+  bool found = false;
+  
+  for (int cy = y0; cy <= y1; cy++)
+  {
+    for (int cx = x0; cx <= x1; cx++)
+    {
+      int cell = find_cell(hash, cx, cy);
+      if (cell < 0)
+        continue;
+
+      spatial_item_t* items = hash->cells[cell].items;
+      for (int i = 0; i < sb_count(items); i++)
+      {
+        if (poly >= 0 && items[i].ref.poly != poly)
+          continue;
+        
+        float dx = items[i].pos.x - pos.x;
+        float dy = items[i].pos.y - pos.y;
+        float d = dx * dx + dy * dy;
+
+        // Ties go to the lowest index, like a linear scan would
+        if (d < best_d
+            || (d == best_d && (!found || ref_less(items[i].ref, *result))))
+        {
+          best_d = d;
+          *result = items[i].ref;
+          found = true;
+        }
+      }
+    }
+  }
+  
+  return found;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "geom.h"
+
+// Uniform grid over polygon vertices, hashed so that only occupied cells
+// use memory. Vertices are referred to by polygon and point index, so the
+// index survives the polygon arrays being reallocated.
+
+typedef struct
+{
+  int poly;
+  int point;
+} vertex_ref_t;
+
+typedef struct
+{
+  point_t pos;
+  vertex_ref_t ref;
+} spatial_item_t;
+
+typedef struct
+{
+  int x;
+  int y;
+  spatial_item_t* items; // kept packed so a query scans them in order
+} spatial_cell_t;
+
+// Where a vertex is stored
+typedef struct
+{
+  int cell;
+  int slot;
+} spatial_handle_t;
+
+typedef struct
+{
+  float cell_size;
+
+  spatial_cell_t* cells;
+  int* table; // open addressed, cell index or -1
+  size_t table_size;
+  
+  spatial_handle_t** handles; // handles[poly][point]
+} spatial_hash_t;
+
+void create_spatial_hash(spatial_hash_t* hash, float cell_size);
+
+void delete_spatial_hash(spatial_hash_t* hash);
+
+void spatial_hash_clear(spatial_hash_t* hash);
+
+// Adds a vertex, or moves it if it is already indexed
+void spatial_hash_insert(spatial_hash_t* hash, vertex_ref_t ref, point_t pos);
+
+// Moves a vertex that was already inserted
+void spatial_hash_move(spatial_hash_t* hash, vertex_ref_t ref, point_t pos);
+
+// Inserts or moves every vertex of a polygon
+void spatial_hash_update_polygon(spatial_hash_t* hash, int poly, polygon_t* p);
+
+// Closest vertex within max_d of pos. If poly is not negative, only
+// vertices of that polygon are considered.
+bool spatial_hash_nearest(spatial_hash_t* hash, point_t pos, float max_d, int poly,
+                          vertex_ref_t* result);
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "draw.h"
+#include "geom.h"
+#include "pixel_display.h"
+
+// Rasterizer checks: polydraw_test_draw
+//
+// Draws random lines with draw_line under random clip rects and compares
+// them with the plain Bresenham loop it replaced, which checked every
+// pixel against the clip rect, so clipping the line up front has to give
+// the same pixels.
+//
+// Scans random self intersecting polygons with scan_fill_rows under both
+// fill rules and compares every pixel with the winding number of the
+// outline around it. Pixel x of row y is the point (x, y), just right of
+// an edge through it. Half the vertices sit on a scanline, so rows through
+// vertices and flat edges are covered.
+
+#define LINES 200000
+#define LINE_W 96
+#define LINE_H 64
+#define LINE_REACH 200 // end points up to this far past the display
+
+#define FILL_POLYGONS 5000
+#define FILL_MAX_POINTS 20
+#define FILL_SIZE 64
+
+// Pixels closer than this to an edge are on it and skipped
+#define FILL_MARGIN 1e-3
+
+static double rand_range(double lo, double hi)
+{
+  return lo + ((hi - lo) * rand() / (double) RAND_MAX);
+}
+
+// Lines
+
+static int step_sign(int v)
+{
+  return (v > 0) - (v < 0);
+}
+
+static void reference_plot(uint32_t* buf, rect_t clip, uint32_t color, int x, int y)
+{
+  if ((x > 0 && x >= clip.x0 && x < clip.x1) && (y > 0 && y >= clip.y0 && y < clip.y1))
+    buf[x + (y * LINE_W)] = color;
+}
+
+// draw_line as it was before clipping, one step at a time
+static void reference_line(uint32_t* buf, rect_t clip, uint32_t color, int x1, int y1, int x2, int y2)
+{
+  int dx = x2 - x1;
+  int dy = y2 - y1;
+  int x_derr = 2 * abs(dx);
+  int y_derr = 2 * abs(dy);
+  int x_incr = step_sign(dx);
+  int y_incr = step_sign(dy);
+
+  if (abs(dx) > abs(dy))
+  {
+    int d = (2 * abs(dy)) - abs(dx);
+    int y = y1;
+    for (int x = x1; x != x2; x += x_incr)
+    {
+      reference_plot(buf, clip, color, x, y);
+      if (d > 0)
+      {
+        y += y_incr;
+        d -= x_derr;
+      }
+      d += y_derr;
+    }
+  }
+  else
+  {
+    int d = (2 * abs(dx)) - abs(dy);
+    int x = x1;
+    for (int y = y1; y != y2; y += y_incr)
+    {
+      reference_plot(buf, clip, color, x, y);
+      if (d > 0)
+      {
+        x += x_incr;
+        d -= y_derr;
+      }
+      d += x_derr;
+    }
+  }
+}
+
+static int rand_coord(int size)
+{
+  return (rand() % (size + (2 * LINE_REACH))) - LINE_REACH;
+}
+
+static int test_lines(void)
+{
+  pixel_display_t display;
+  create_mem_pixel_display(&display, LINE_W, LINE_H);
+  uint32_t* reference = (uint32_t*) calloc(LINE_W * LINE_H, sizeof(uint32_t));
+  pixel_t color = {.r = 255, .g = 128, .b = 64, .a = 255};
+  uint32_t c;
+  memcpy(&c, &color, sizeof(c));
+
+  int errors = 0;
+  for (int it = 0; it < LINES; it++)
+  {
+    rect_t clip = {.x0 = 0, .y0 = 0, .x1 = LINE_W, .y1 = LINE_H};
+    if (it % 2)
+    {
+      clip.x0 = rand() % LINE_W;
+      clip.y0 = rand() % LINE_H;
+      clip.x1 = clip.x0 + (rand() % (LINE_W - clip.x0 + 1));
+      clip.y1 = clip.y0 + (rand() % (LINE_H - clip.y0 + 1));
+    }
+
+    // Short lines inside the display as well as long ones through it
+    int x1 = rand_coord(LINE_W);
+    int y1 = rand_coord(LINE_H);
+    int x2 = it % 4 < 2 ? rand_coord(LINE_W) : x1 + (rand() % 9) - 4;
+    int y2 = it % 4 < 2 ? rand_coord(LINE_H) : y1 + (rand() % 9) - 4;
+
+    memset(display.buf, 0, sizeof(pixel_t) * LINE_W * LINE_H);
+    memset(reference, 0, sizeof(uint32_t) * LINE_W * LINE_H);
+    pixel_display_set_clip(&display, clip);
+    draw_line(&display, color, x1, y1, x2, y2);
+    reference_line(reference, clip, c, x1, y1, x2, y2);
+    if (memcmp(display.buf, reference, sizeof(uint32_t) * LINE_W * LINE_H))
+      errors++;
+  }
+
+  free(reference);
+  delete_pixel_display(&display);
+  printf("lines: %s\n", errors ? "FAILED" : "ok");
+  return errors;
+}
+
+// Fill rules
+
+static double segment_distance(point_t a, point_t b, double x, double y)
+{
+  double dx = (double) b.x - a.x;
+  double dy = (double) b.y - a.y;
+  double len2 = (dx * dx) + (dy * dy);
+  double t = len2 > 0 ? (((x - a.x) * dx) + ((y - a.y) * dy)) / len2 : 0;
+  t = t < 0 ? 0 : (t > 1 ? 1 : t);
+  double ex = x - (a.x + (t * dx));
+  double ey = y - (a.y + (t * dy));
+  return sqrt((ex * ex) + (ey * ey));
+}
+
+static int winding_number(const polygon_t* p, double x, double y)
+{
+  int winding = 0;
+  for (int i = 0; i < p->num_points; i++)
+  {
+    point_t a = p->points[i];
+    point_t b = p->points[(i + 1) % p->num_points];
+    double side = (((double) b.x - a.x) * (y - a.y)) - (((double) b.y - a.y) * (x - a.x));
+    if (a.y <= y && b.y > y && side > 0)
+      winding++;
+    else if (b.y <= y && a.y > y && side < 0)
+      winding--;
+  }
+  return winding;
+}
+
+// Times each pixel was emitted, plus one entry for spans out of bounds
+typedef struct
+{
+  unsigned char hits[FILL_SIZE * FILL_SIZE];
+  int outside;
+} fill_grid_t;
+
+static void grid_span(void* data, int y, int x0, int x1)
+{
+  fill_grid_t* grid = (fill_grid_t*) data;
+  if (y < 0 || y >= FILL_SIZE || x0 < 0 || x1 > FILL_SIZE)
+  {
+    grid->outside++;
+    return;
+  }
+  for (int x = x0; x < x1; x++)
+    grid->hits[(y * FILL_SIZE) + x]++;
+}
+
+// Is (x, y) within FILL_MARGIN of an edge
+static bool near_edge(const polygon_t* p, double x, double y)
+{
+  for (int i = 0; i < p->num_points; i++)
+  {
+    point_t a = p->points[i];
+    point_t b = p->points[(i + 1) % p->num_points];
+    if (x < fminf(a.x, b.x) - FILL_MARGIN || x > fmaxf(a.x, b.x) + FILL_MARGIN
+        || y < fminf(a.y, b.y) - FILL_MARGIN || y > fmaxf(a.y, b.y) + FILL_MARGIN)
+      continue;
+    if (segment_distance(a, b, x, y) < FILL_MARGIN)
+      return true;
+  }
+  return false;
+}
+
+// Errors of the even-odd and non-zero fills are added to errors[0] and [1]
+static void check_fill(polygon_t* p, int* errors)
+{
+  fill_grid_t grids[2];
+  static const fill_rule_t rules[2] = {FILL_EVEN_ODD, FILL_NON_ZERO};
+  bool ok[2];
+  for (int r = 0; r < 2; r++)
+  {
+    memset(grids + r, 0, sizeof(fill_grid_t));
+    scan_fill_rows(p, 0, FILL_SIZE, rules[r], grid_span, grids + r);
+    ok[r] = !grids[r].outside;
+  }
+
+  for (int i = 0; i < FILL_SIZE * FILL_SIZE && (ok[0] || ok[1]); i++)
+  {
+    int x = i % FILL_SIZE;
+    int y = i / FILL_SIZE;
+    if (grids[0].hits[i] > 1)
+      ok[0] = false;
+    if (grids[1].hits[i] > 1)
+      ok[1] = false;
+    int winding = winding_number(p, x, y);
+    if ((!grids[0].hits[i] && !grids[1].hits[i] && !winding) || near_edge(p, x, y))
+      continue;
+    if ((grids[0].hits[i] == 1) != (bool) (winding & 1))
+      ok[0] = false;
+    if ((grids[1].hits[i] == 1) != (winding != 0))
+      ok[1] = false;
+  }
+  errors[0] += !ok[0];
+  errors[1] += !ok[1];
+}
+
+static int test_fill_rules(void)
+{
+  int errors[2] = {0, 0};
+  point_t points[FILL_MAX_POINTS];
+  for (int it = 0; it < FILL_POLYGONS; it++)
+  {
+    int n = 3 + (rand() % (FILL_MAX_POINTS - 2));
+    for (int i = 0; i < n; i++)
+    {
+      points[i].x = rand_range(2, FILL_SIZE - 2);
+      points[i].y = rand_range(2, FILL_SIZE - 2);
+      if (rand() % 2)
+        points[i].y = floorf(points[i].y);
+      if (rand() % 4 == 0)
+        points[i].x = floorf(points[i].x);
+    }
+
+    polygon_t p;
+    create_polygon_from_points(&p, points, n);
+    check_fill(&p, errors);
+    delete_polygon(&p);
+  }
+
+  printf("fill rules, even-odd: %s, non-zero: %s\n",
+         errors[0] ? "FAILED" : "ok", errors[1] ? "FAILED" : "ok");
+  return errors[0] + errors[1];
+}
+
+int main(void)
+{
+  srand(1);
+  int failed = 0;
+  failed += test_lines() != 0;
+  failed += test_fill_rules() != 0;
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
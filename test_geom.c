@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "geom.h"
+
+// Geometry checks: polydraw_test_geom
+//
+// Triangulates random simple polygons, star shaped ones and ones on a
+// small integer grid where many vertices share an x, wound both ways.
+// Every triangulation has to cover the same sample points as
+// polygon_contains_point, each exactly once, with every triangle wound
+// the way the polygon is. Outlines that touch themselves have to come
+// back NULL, so the fill falls back to scanning them.
+
+#define STAR_POLYGONS 2000
+#define STAR_MAX_POINTS 40
+#define GRID_POLYGONS 5000
+#define GRID_MAX_POINTS 12
+#define GRID_SIZE 8
+#define SAMPLES 200
+
+// Samples closer than this to an edge or a diagonal are skipped
+#define SAMPLE_MARGIN 1e-3
+
+static double rand_range(double lo, double hi)
+{
+  return lo + ((hi - lo) * rand() / (double) RAND_MAX);
+}
+
+static double cross(point_t a, point_t b, point_t c)
+{
+  return (((double) b.x - a.x) * ((double) c.y - a.y)) - (((double) b.y - a.y) * ((double) c.x - a.x));
+}
+
+static double segment_distance(point_t a, point_t b, point_t p)
+{
+  double dx = (double) b.x - a.x;
+  double dy = (double) b.y - a.y;
+  double len2 = (dx * dx) + (dy * dy);
+  double t = len2 > 0 ? ((((double) p.x - a.x) * dx) + (((double) p.y - a.y) * dy)) / len2 : 0;
+  t = t < 0 ? 0 : (t > 1 ? 1 : t);
+  double ex = (double) p.x - (a.x + (t * dx));
+  double ey = (double) p.y - (a.y + (t * dy));
+  return sqrt((ex * ex) + (ey * ey));
+}
+
+static double signed_area(const point_t* p, int n)
+{
+  double area = 0;
+  for (int i = 0; i < n; i++)
+    area += cross(p[0], p[i], p[(i + 1) % n]);
+  return area / 2;
+}
+
+static void reverse_points(point_t* p, int n)
+{
+  for (int i = 0; i < n / 2; i++)
+  {
+    point_t t = p[i];
+    p[i] = p[n - 1 - i];
+    p[n - 1 - i] = t;
+  }
+}
+
+// Compares the triangles of poly with polygon_contains_point at random
+// points of its bounds
+static bool check_triangles(polygon_t* poly, const int* tris, size_t num_triangles)
+{
+  const point_t* p = poly->points;
+  double area = signed_area(p, poly->num_points);
+  double tri_area = 0;
+  for (size_t i = 0; i < num_triangles; i++)
+  {
+    double a = cross(p[tris[3 * i]], p[tris[(3 * i) + 1]], p[tris[(3 * i) + 2]]) / 2;
+    if (a * area < 0)
+      return false;
+    tri_area += a;
+  }
+  if (fabs(tri_area - area) > 1e-6 * fabs(area))
+    return false;
+
+  aabb_t b = polygon_bounds(poly);
+  for (int s = 0; s < SAMPLES; s++)
+  {
+    point_t x = {.x = rand_range(b.min.x - 1, b.max.x + 1), .y = rand_range(b.min.y - 1, b.max.y + 1)};
+
+    bool near = false;
+    for (int i = 0; i < poly->num_points && !near; i++)
+      near = segment_distance(p[i], p[(i + 1) % poly->num_points], x) < SAMPLE_MARGIN;
+    for (size_t i = 0; i < 3 * num_triangles && !near; i++)
+      near = segment_distance(p[tris[i]], p[tris[i % 3 == 2 ? i - 2 : i + 1]], x) < SAMPLE_MARGIN;
+    if (near)
+      continue;
+
+    int covered = 0;
+    for (size_t i = 0; i < num_triangles; i++)
+    {
+      point_t t0 = p[tris[3 * i]];
+      point_t t1 = p[tris[(3 * i) + 1]];
+      point_t t2 = p[tris[(3 * i) + 2]];
+      double o = cross(t0, t1, t2);
+      if (cross(t0, t1, x) * o > 0 && cross(t1, t2, x) * o > 0 && cross(t2, t0, x) * o > 0)
+        covered++;
+    }
+    if (covered != (polygon_contains_point(poly, x) ? 1 : 0))
+      return false;
+  }
+  return true;
+}
+
+// Star shaped
+
+static int test_star(void)
+{
+  int errors = 0;
+  point_t p[STAR_MAX_POINTS];
+  for (int it = 0; it < STAR_POLYGONS; it++)
+  {
+    int n = 3 + (rand() % (STAR_MAX_POINTS - 2));
+    double angles[STAR_MAX_POINTS];
+    for (int i = 0; i < n; i++)
+      angles[i] = rand_range(0, 2 * M_PI);
+    for (int i = 1; i < n; i++)
+    {
+      double a = angles[i];
+      int j = i;
+      for (; j > 0 && angles[j - 1] > a; j--)
+        angles[j] = angles[j - 1];
+      angles[j] = a;
+    }
+    for (int i = 0; i < n; i++)
+    {
+      double r = rand_range(1, 100);
+      p[i].x = r * cos(angles[i]);
+      p[i].y = r * sin(angles[i]);
+    }
+    if (it % 2)
+      reverse_points(p, n);
+
+    polygon_t poly;
+    create_polygon_from_points(&poly, p, n);
+    if (!polygon_is_complex(&poly))
+    {
+      size_t num_triangles;
+      const int* tris = polygon_triangles(&poly, &num_triangles);
+      if (!tris || num_triangles != (size_t) n - 2 || !check_triangles(&poly, tris, num_triangles))
+        errors++;
+    }
+    delete_polygon(&poly);
+  }
+
+  printf("star polygons: %s\n", errors ? "FAILED" : "ok");
+  return errors;
+}
+
+// Integer grid
+
+static int orientation(point_t a, point_t b, point_t c)
+{
+  double c1 = cross(a, b, c);
+  return (c1 > 0) - (c1 < 0);
+}
+
+static bool on_segment(point_t a, point_t b, point_t p)
+{
+  return orientation(a, b, p) == 0
+    && p.x >= fminf(a.x, b.x) && p.x <= fmaxf(a.x, b.x)
+    && p.y >= fminf(a.y, b.y) && p.y <= fmaxf(a.y, b.y);
+}
+
+static bool segments_touch(point_t a, point_t b, point_t c, point_t d)
+{
+  int o1 = orientation(a, b, c);
+  int o2 = orientation(a, b, d);
+  int o3 = orientation(c, d, a);
+  int o4 = orientation(c, d, b);
+  if (o1 * o2 < 0 && o3 * o4 < 0)
+    return true;
+  return on_segment(a, b, c) || on_segment(a, b, d) || on_segment(c, d, a) || on_segment(c, d, b);
+}
+
+// Exact on the grid: no edges meet except neighbours at their shared end
+static bool grid_is_simple(const point_t* p, int n)
+{
+  for (int i = 0; i < n; i++)
+  {
+    point_t a = p[i];
+    point_t b = p[(i + 1) % n];
+    if (a.x == b.x && a.y == b.y)
+      return false;
+    for (int j = i + 1; j < n; j++)
+    {
+      point_t c = p[j];
+      point_t d = p[(j + 1) % n];
+      if (j == i + 1)
+      {
+        if (on_segment(a, b, d) || on_segment(c, d, a))
+          return false;
+      }
+      else if (i == 0 && j == n - 1)
+      {
+        if (on_segment(a, b, c) || on_segment(c, d, b))
+          return false;
+      }
+      else if (segments_touch(a, b, c, d))
+        return false;
+    }
+  }
+  return true;
+}
+
+// Reverses the stretch between crossing edges until none cross
+static void uncross(point_t* p, int n)
+{
+  for (int it = 0; it < 1000; it++)
+  {
+    bool found = false;
+    for (int i = 0; i < n && !found; i++)
+    {
+      for (int j = i + 2; j < n && !found; j++)
+      {
+        if (i == 0 && j == n - 1)
+          continue;
+        if (!lines_intersect(p[i], p[i + 1], p[j], p[(j + 1) % n]))
+          continue;
+        reverse_points(p + i + 1, j - i);
+        found = true;
+      }
+    }
+    if (!found)
+      return;
+  }
+}
+
+static int test_grid(void)
+{
+  int errors = 0;
+  int tested = 0;
+  point_t p[GRID_MAX_POINTS];
+  for (int it = 0; it < GRID_POLYGONS; it++)
+  {
+    int n = 3 + (rand() % (GRID_MAX_POINTS - 2));
+    for (int i = 0; i < n; i++)
+    {
+      p[i].x = rand() % GRID_SIZE;
+      p[i].y = rand() % GRID_SIZE;
+    }
+    uncross(p, n);
+    if (!grid_is_simple(p, n) || signed_area(p, n) == 0)
+      continue;
+    if (it % 2)
+      reverse_points(p, n);
+
+    polygon_t poly;
+    create_polygon_from_points(&poly, p, n);
+    size_t num_triangles;
+    const int* tris = polygon_triangles(&poly, &num_triangles);
+    if (!tris || !check_triangles(&poly, tris, num_triangles))
+      errors++;
+    tested++;
+    delete_polygon(&poly);
+  }
+
+  printf("grid polygons, %d simple: %s\n", tested, errors ? "FAILED" : "ok");
+  return errors;
+}
+
+// Self touching
+
+typedef struct
+{
+  const char* name;
+  point_t points[8];
+  int num_points;
+} touching_t;
+
+static int test_touching(void)
+{
+  static const touching_t outlines[] = {
+    {"figure eight", {{0, 0}, {2, 0}, {1, 1}, {2, 2}, {0, 2}, {1, 1}}, 6},
+    {"spike", {{0, 0}, {4, 0}, {4, 4}, {2, 4}, {2, 2}, {2, 4}, {0, 4}}, 7},
+    {"doubled edge", {{0, 0}, {4, 0}, {4, 4}, {0, 4}, {0, 2}, {2, 2}, {0, 2}}, 7},
+    {"touching hole", {{0, 0}, {6, 0}, {6, 6}, {3, 6}, {3, 3}, {4, 3}, {4, 5}, {3, 6}}, 8},
+    {"flat", {{0, 0}, {1, 0}, {2, 0}}, 3},
+    {"bow tie", {{0, 0}, {4, 0}, {0, 4}, {4, 4}}, 4},
+  };
+
+  int errors = 0;
+  for (int i = 0; i < sizeof(outlines) / sizeof(outlines[0]); i++)
+  {
+    polygon_t poly;
+    create_polygon_from_points(&poly, outlines[i].points, outlines[i].num_points);
+    size_t num_triangles;
+    if (polygon_triangles(&poly, &num_triangles))
+    {
+      printf("%s: not NULL\n", outlines[i].name);
+      errors++;
+    }
+    delete_polygon(&poly);
+  }
+
+  printf("self touching outlines: %s\n", errors ? "FAILED" : "ok");
+  return errors;
+}
+
+int main(void)
+{
+  srand(1);
+  int failed = 0;
+  failed += test_star() != 0;
+  failed += test_grid() != 0;
+  failed += test_touching() != 0;
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "job.h"
+
+// Job system checks: polydraw_test_job
+//
+// Runs chains of batches where each batch starts after the one before it,
+// on pools of several sizes, and checks every stage saw the previous one
+// finished. A deadlock shows up as the test timing out.
+
+#define STAGES 3
+#define STAGE_SIZE 64
+#define ITERATIONS 200
+
+typedef struct
+{
+  int stage;
+  int* done;   // finished jobs per stage
+  int* errors;
+} chain_stage_t;
+
+static void run_stage(void* data, int index)
+{
+  chain_stage_t* s = (chain_stage_t*) data;
+  if (s->stage && __atomic_load_n(s->done + s->stage - 1, __ATOMIC_ACQUIRE) != STAGE_SIZE)
+    __atomic_add_fetch(s->errors, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(s->done + s->stage, 1, __ATOMIC_RELEASE);
+}
+
+static int test_chain(int num_threads)
+{
+  job_pool_t pool;
+  create_job_pool(&pool, num_threads);
+
+  int errors = 0;
+  for (int it = 0; it < ITERATIONS; it++)
+  {
+    int done[STAGES] = {0};
+    job_counter_t counters[STAGES] = {{0}};
+    chain_stage_t stages[STAGES];
+    for (int i = 0; i < STAGES; i++)
+    {
+      stages[i].stage = i;
+      stages[i].done = done;
+      stages[i].errors = &errors;
+      job_run(&pool, STAGE_SIZE, run_stage, stages + i, i ? counters + i - 1 : NULL, counters + i);
+    }
+    job_wait(&pool, counters + STAGES - 1);
+
+    for (int i = 0; i < STAGES; i++)
+    {
+      // Earlier stages are only waited on through the last one
+      job_wait(&pool, counters + i);
+      if (done[i] != STAGE_SIZE)
+        errors++;
+    }
+  }
+
+  delete_job_pool(&pool);
+  printf("chain, %d threads: %s\n", num_threads, errors ? "FAILED" : "ok");
+  return errors;
+}
+
+int main(void)
+{
+  static const int threads[] = {1, 2, 3, 4, 8};
+  int failed = 0;
+  for (int i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+    failed += test_chain(threads[i]) != 0;
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,14 @@
+#include <stdlib.h>
+
+#include "kernels_check.h"
+
+// SIMD kernel checks: polydraw_test_kernels
+//
+// Compares the kernels of every level the CPU supports with the scalar
+// ones, the same run as polydraw_bench --check.
+
+int main(void)
+{
+  srand(1);
+  return check_kernels() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
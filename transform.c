@@ -1,4 +1,5 @@
 #include "transform.h"
+#include "cpu.h"
 #include <string.h>
 #include <math.h>
 
@@ -118,3 +119,12 @@ void mat3_identity(mat3_t* result)
     result->vals[i + (3 * i)] = 1;
   }
 }
+
+void mat3_transform_points(const mat3_t* mat, point_t origin, point_t* points, size_t num_points)
+{
+  // The origin is folded into the translation
+  const float* v = mat->vals;
+  float m[6] = {v[0], v[1], v[2] + origin.x - (v[0] * origin.x) - (v[1] * origin.y),
+                v[3], v[4], v[5] + origin.y - (v[3] * origin.x) - (v[4] * origin.y)};
+  draw_kernels()->transform(points, num_points, m);
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "geom.h"
+
 typedef struct
 {
   float vals[2];
@@ -38,3 +40,6 @@ void mat3_shear(float hx, float hy, mat3_t* result);
 void mat3_reflect(mat3_t* result);
 
 void mat3_identity(mat3_t* result);
+
+// points = mat * (points - origin) + origin, ignoring the bottom row of mat
+void mat3_transform_points(const mat3_t* mat, point_t origin, point_t* points, size_t num_points);